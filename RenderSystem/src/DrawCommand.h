@@ -2,21 +2,72 @@
 #include <vulkan/vulkan.h>
 #include <array>
 
+struct VkRSpipeline;
+
+/**
+ * @brief Push constants of every draw, laid out as the DrawConstants block of the vertex shaders.
+ */
+struct VkRSdrawConstants
+{
+    glm::vec4 positionScale = glm::vec4(1.0f);
+    glm::vec4 positionBias = glm::vec4(0.0f);
+    uint32_t spatialSlot = 0; //unused by instanced draws, which read their slots from the instance buffer
+    uint32_t octahedralNormals = 0;
+};
+
 struct VkRSdrawCommand
 {
     RSvertexAttributeSettings attribSetting;
     std::vector<VkBuffer> vertexBuffers{};
+    std::vector<VkDeviceSize> vertexBufferOffsets{}; //binding offsets in bytes, one per vertex buffer
     VkBuffer indicesBuffer = VK_NULL_HANDLE;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
     bool isIndexed = true;
     uint32_t numIndices = 0;
     uint32_t numVertices = 0;
-    VkDeviceSize vertexOffset = 0;
-    VkDeviceSize indicesOffset = 0;
+    uint32_t vertexOffset = 0; //first vertex of the geometry data in its vertex buffer
+    uint32_t indicesOffset = 0; //first index of the geometry data in its index buffer
+    //dynamic geometry data is bound at its current copy, which moves by the copy strides of its buffers
+    bool dynamicGeometry = false;
+    std::vector<VkDeviceSize> vertexCopyStrides{};
+    VkDeviceSize indicesCopyStride = 0;
     RSappearanceID appID;
     
     VkPrimitiveTopology primTopology;
     VkPipelineLayout pipelineLayout{};
-    VkPipeline graphicsPipeline{};
+    VkRSpipeline* pipeline = nullptr; //shared entry of the pipeline registry, may still be compiling
     RSspatialID spatialID;
+    VkRSdrawConstants drawConstants; //how the attributes of the geometry data are decoded, the spatial slot is set per draw
     RSstate state;
+
+    //identifies the instance and the resources used to sort the collection draw list
+    RSinstanceID instanceID;
+    RSgeometryDataID gdataID;
+    RSstateID stateID;
+};
+
+/**
+ * @brief A run of adjacent slots in a collection draw list. Instanced batches merge instances sharing
+ * geometry data, appearance and state into a single draw whose spatials are read from a storage buffer.
+ */
+struct VkRSdrawBatch
+{
+    uint32_t firstSlot = 0;
+    uint32_t numSlots = 0;
+    bool instanced = false;
+    
+    //only valid for instanced batches
+    uint32_t firstInstance = 0;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkRSpipeline* pipeline = nullptr;
+};
+
+/**
+ * @brief A run of adjacent batches recorded into one secondary command buffer, so that large collections
+ * can be recorded by several threads.
+ */
+struct VkRSrecordChunk
+{
+    uint32_t firstBatch = 0;
+    uint32_t numBatches = 0;
 };
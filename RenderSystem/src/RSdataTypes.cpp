@@ -20,23 +20,29 @@ uint32_t RSvertexAttribsInfo::sizeOfInterleavedAttrib() const {
     return sum;
 }
 
+RSvertexFormat RSvertexAttribsInfo::getFormat(RSvertexAttribute attrib) const {
+    return formats[static_cast<uint32_t>(attrib)];
+}
+
 uint32_t RSvertexAttribsInfo::sizeOfAttrib(RSvertexAttribute attrib) const {
+    const uint32_t numComponents = attrib == RSvertexAttribute::vaTexCoord ? 2 : 4;
     uint32_t sz = 0;
-    switch (attrib) {
-        case RSvertexAttribute::vaPosition:
-            sz = sizeof(glm::vec4);
+    switch (getFormat(attrib)) {
+        case RSvertexFormat::vfFloat:
+            sz = numComponents * sizeof(float);
             break;
 
-        case RSvertexAttribute::vaNormal:
-            sz = sizeof(glm::vec4);
+        case RSvertexFormat::vfHalf:
+        case RSvertexFormat::vfSnorm16:
+            sz = numComponents * sizeof(uint16_t);
             break;
 
-        case RSvertexAttribute::vaColor:
-            sz = sizeof(glm::vec4);
+        case RSvertexFormat::vfOctahedral:
+            sz = 2 * sizeof(uint16_t);
             break;
 
-        case RSvertexAttribute::vaTexCoord:
-            sz = sizeof(glm::vec2);
+        case RSvertexFormat::vfUnorm8:
+            sz = numComponents * sizeof(uint8_t);
             break;
     }
     
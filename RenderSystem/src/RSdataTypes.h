@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <vector>
+#include <array>
 #include <string>
 #include "RStypes.h"
 #include "rsenums.h"
@@ -25,6 +26,11 @@ struct RSinitInfo
     bool onScreenCanvas = true;
     char appName[256]; //name of the engine or application
     char shaderPath[256];
+    uint32_t numRecordingThreads = 0; //threads recording collections into secondary command buffers, 0 records on the calling thread
+    uint32_t numPipelineThreads = 0; //threads compiling graphics pipelines in the background, 0 compiles them in collectionFinalize
+    bool sharedGeometryBuffers = false; //place geometry data in ranges of a few large vertex and index buffers
+    uint64_t stagingRingSize = 64ull * 1024 * 1024; //bytes of the persistently mapped staging ring uploads are staged in
+    char pipelineCachePath[256] = {}; //file the pipeline cache is seeded from at init and written to at dispose, empty keeps it in memory
 #if defined(_WIN32)
     HWND parentHwnd{};
     HINSTANCE parentHinst{};
@@ -37,6 +43,7 @@ struct RScontextInfo
 {
     uint32_t initWidth = 800;
     uint32_t initHeight = 600;
+    uint32_t framesInFlight = 2; //frames recorded ahead of the GPU, clamped to [1, VkRScontext::MAX_FRAMES_IN_FLIGHT]
     char title[256]{0}; //name of the window displayed as title
 #if defined(_WIN32)
     HWND hwnd{};
@@ -62,6 +69,12 @@ struct RSvertexAttribsInfo
     uint32_t numVertexAttribs = 0;
     RSvertexAttribute* attributes = nullptr;
     RSvertexAttributeSettings settings;
+    RSbufferUsageHint usageHint = RSbufferUsageHint::buStatic;
+    std::array<RSvertexFormat, 4> formats{}; //format of each attribute indexed by RSvertexAttribute, vfFloat by default
+    //positions are dequantized in the vertex shader as position * scale + bias, for vfSnorm16 this maps [-1, 1] to the bounds
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionBias = glm::vec3(0.0f);
+    RSvertexFormat getFormat(RSvertexAttribute attrib) const;
     uint32_t sizeOfInterleavedAttrib() const;
     uint32_t sizeOfAttrib(RSvertexAttribute attrib) const;
     std::string getName(RSvertexAttribute attrib) const;
@@ -89,6 +102,7 @@ struct RSvolumeSliceAppearance
 {
     glm::vec2 window{};
     glm::vec2 rescale{};
+    float lodBias = 0.0f; //added to the mip level picked from the voxel density on screen, positive values pick coarser levels
 };
 
 struct RSappearanceInfo 
@@ -144,3 +158,38 @@ struct RSvolumeChunk
     int32_t xoffset = 0, yoffset = 0, zoffset = 0;
     uint32_t xcount = 0, ycount = 0, zcount = 0;
 };
+
+/**
+ * @brief Layout of a bricked volume texture. Only the bricks the volume slices intersect are kept on the device, in a
+ * brick pool atlas, so volumes larger than device memory can be displayed.
+ */
+struct RSbrickedVolumeInfo
+{
+    uint32_t brickSize = 64; //voxels along each side of a brick, a power of two from 8 to 256
+    uint64_t poolBytes = 256ull * 1024 * 1024; //device memory budget of the brick pool atlas
+};
+
+/**
+ * @brief Pipeline creation statistics, to compare cold and warm starts.
+ */
+struct RSpipelineStats
+{
+    uint32_t registryHits = 0; //draws that shared a pipeline created earlier in the session
+    uint32_t pipelinesCreated = 0; //pipelines created by the driver
+    uint32_t pipelineCacheHits = 0; //created pipelines the driver found in the pipeline cache, needs a Vulkan 1.3 device to be counted
+    uint32_t pipelinesPending = 0; //pipelines still compiling on the pipeline threads
+    double creationMilliseconds = 0.0; //time spent creating pipelines
+    bool cacheLoaded = false; //the pipeline cache was seeded from RSinitInfo::pipelineCachePath
+};
+
+/**
+ * @brief Device memory statistics of the render system allocator.
+ */
+struct RSmemoryStats
+{
+    uint32_t numBlocks = 0; //device memory allocations backing all resources
+    uint32_t numAllocations = 0; //buffers and images placed in the blocks
+    uint64_t bytesReserved = 0; //total size of the blocks
+    uint64_t bytesUsed = 0; //bytes handed out, including alignment padding
+    float fragmentation = 0.0f; //1 - largest free range / total free bytes, 0 when free memory is contiguous
+};
@@ -7,6 +7,28 @@
 #include <algorithm>
 #include <numeric>
 #include <iostream>
+#include <thread>
+#include <vector>
+#include <assert.h>
+#include <cmath>
+#include <cstring>
+
+// The noise kernels below must not have their multiplies and adds contracted into FMAs, see ScalarLanes
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RS_NOISE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RS_NOISE_SSE2
+#endif
 
 void RStextureInfo::dispose()
 {
@@ -21,145 +43,269 @@ void RStextureInfo::dispose()
     this->texels = nullptr;
 }
 
-// Translation of Ken Perlin's JAVA implementation (http://mrl.nyu.edu/~perlin/noise/)
-template <typename T>
+// Float and integer lanes the noise kernels are written against, one voxel along x per lane. Every lane type performs the same
+// IEEE single precision operations in the same order, so all of them generate bit-identical volumes as long as the compiler does
+// not contract multiplies and adds into FMAs, which the pragmas at the top of this file turn off. x87 builds without SSE2 keep
+// excess precision and are not covered.
+struct ScalarLanes
+{
+    typedef float F;
+    typedef int32_t I;
+    static const uint32_t WIDTH = 1;
+    
+    static F set(float a) { return a; }
+    static I seti(int32_t a) { return a; }
+    static I iota(int32_t base) { return base; }
+    static F toFloat(I a) { return static_cast<float>(a); }
+    static I toInt(F a) { return static_cast<int32_t>(a); }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F div(F a, F b) { return a / b; }
+    static F floor(F a) { return std::floor(a); }
+    static I addi(I a, I b) { return a + b; }
+    static I andi(I a, I b) { return a & b; }
+    static I ori(I a, I b) { return a | b; }
+    static I lessThan(I a, I b) { return a < b ? -1 : 0; }
+    static I equal(I a, I b) { return a == b ? -1 : 0; }
+    static F select(I mask, F a, F b) { return mask ? a : b; }
+    static F negateIf(I mask, F a) { return mask ? -a : a; }
+    static I gather(const int32_t* table, I index) { return table[index]; }
+    static void store(float* out, F a) { *out = a; }
+};
+
+#if defined(RS_NOISE_SSE2)
+struct SSE2Lanes
+{
+    typedef __m128 F;
+    typedef __m128i I;
+    static const uint32_t WIDTH = 4;
+    
+    static F set(float a) { return _mm_set1_ps(a); }
+    static I seti(int32_t a) { return _mm_set1_epi32(a); }
+    static I iota(int32_t base) { return _mm_add_epi32(_mm_set1_epi32(base), _mm_setr_epi32(0, 1, 2, 3)); }
+    static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+    static I toInt(F a) { return _mm_cvttps_epi32(a); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static F floor(F a)
+    {
+        // SSE2 has no rounding instruction, truncation is one too high for negative fractions. Exact below 2^31
+        const F truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a), _mm_set1_ps(1.0f)));
+    }
+    static I addi(I a, I b) { return _mm_add_epi32(a, b); }
+    static I andi(I a, I b) { return _mm_and_si128(a, b); }
+    static I ori(I a, I b) { return _mm_or_si128(a, b); }
+    static I lessThan(I a, I b) { return _mm_cmplt_epi32(a, b); }
+    static I equal(I a, I b) { return _mm_cmpeq_epi32(a, b); }
+    static F select(I mask, F a, F b)
+    {
+        const F m = _mm_castsi128_ps(mask);
+        return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+    }
+    static F negateIf(I mask, F a) { return _mm_xor_ps(a, _mm_and_ps(_mm_castsi128_ps(mask), _mm_set1_ps(-0.0f))); }
+    static I gather(const int32_t* table, I index)
+    {
+        alignas(16) int32_t indices[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices), index);
+        return _mm_setr_epi32(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]);
+    }
+    static void store(float* out, F a) { _mm_storeu_ps(out, a); }
+};
+#endif
+
+#if defined(RS_NOISE_AVX2)
+struct AVX2Lanes
+{
+    typedef __m256 F;
+    typedef __m256i I;
+    static const uint32_t WIDTH = 8;
+    
+    static F set(float a) { return _mm256_set1_ps(a); }
+    static I seti(int32_t a) { return _mm256_set1_epi32(a); }
+    static I iota(int32_t base) { return _mm256_add_epi32(_mm256_set1_epi32(base), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+    static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+    static I toInt(F a) { return _mm256_cvttps_epi32(a); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F floor(F a) { return _mm256_floor_ps(a); }
+    static I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+    static I andi(I a, I b) { return _mm256_and_si256(a, b); }
+    static I ori(I a, I b) { return _mm256_or_si256(a, b); }
+    static I lessThan(I a, I b) { return _mm256_cmpgt_epi32(b, a); }
+    static I equal(I a, I b) { return _mm256_cmpeq_epi32(a, b); }
+    static F select(I mask, F a, F b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask)); }
+    static F negateIf(I mask, F a) { return _mm256_xor_ps(a, _mm256_and_ps(_mm256_castsi256_ps(mask), _mm256_set1_ps(-0.0f))); }
+    static I gather(const int32_t* table, I index) { return _mm256_i32gather_epi32(table, index, 4); }
+    static void store(float* out, F a) { _mm256_storeu_ps(out, a); }
+};
+typedef AVX2Lanes NoiseLanes;
+#elif defined(RS_NOISE_SSE2)
+typedef SSE2Lanes NoiseLanes;
+#else
+typedef ScalarLanes NoiseLanes;
+#endif
+
+// Translation of Ken Perlin's JAVA implementation (http://mrl.nyu.edu/~perlin/noise/), evaluated for a run of voxels along x at
+// once. The voxels of a run share y and z, so only x is kept per lane.
 class PerlinNoise
 {
     private:
-    RStextureFormat _texformat;
-    std::vector<uint32_t> permutations;
-    T fade(T t)
+    int32_t _mask = 0;
+    std::vector<int32_t> permutations;
+    
+    template <typename L>
+    static typename L::F fade(typename L::F t)
     {
-        return t * t * t * (t * (t * (T)6 - (T)15) + (T)10);
+        // t * t * t * (t * (t * 6 - 15) + 10)
+        const typename L::F t3 = L::mul(L::mul(t, t), t);
+        return L::mul(t3, L::add(L::mul(t, L::sub(L::mul(t, L::set(6.0f)), L::set(15.0f))), L::set(10.0f)));
     }
-    T lerp(T t, T a, T b)
+    template <typename L>
+    static typename L::F lerp(typename L::F t, typename L::F a, typename L::F b)
     {
-        return a + t * (b - a);
+        return L::add(a, L::mul(t, L::sub(b, a)));
     }
-    T grad(int hash, T x, T y, T z)
+    template <typename L>
+    static typename L::F grad(typename L::I hash, typename L::F x, typename L::F y, typename L::F z)
     {
         // Convert LO 4 bits of hash code into 12 gradient directions
-        int h = hash & 15;
-        T u = h < 8 ? x : y;
-        T v = h < 4 ? y : h == 12 || h == 14 ? x : z;
-        return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
-    }
-    public:
-    PerlinNoise()
-    {
+        const typename L::I h = L::andi(hash, L::seti(15));
+        const typename L::F u = L::select(L::lessThan(h, L::seti(8)), x, y);
+        const typename L::F v = L::select(L::lessThan(h, L::seti(4)), y, L::select(L::ori(L::equal(h, L::seti(12)), L::equal(h, L::seti(14))), x, z));
+        const typename L::F signedU = L::negateIf(L::equal(L::andi(h, L::seti(1)), L::seti(1)), u);
+        const typename L::F signedV = L::negateIf(L::equal(L::andi(h, L::seti(2)), L::seti(2)), v);
+        return L::add(signedU, signedV);
     }
     
-    PerlinNoise(RStextureFormat texformat)
+    public:
+    PerlinNoise(RStextureFormat texformat, std::mt19937& rndEngine)
     {
-        _texformat = texformat;
-
-        uint32_t sz = 0;
-        if(texformat == RStextureFormat::tfUnsignedBytes)
+        // Random lookup for permutations containing all numbers from 0..255 or 0..65535. Shuffled by hand since std::shuffle
+        // differs between standard libraries, which would make a seed generate a different volume on each platform
+        const uint32_t sz = texformat == RStextureFormat::tfUnsignedBytes ? 256 : 65536;
+        _mask = static_cast<int32_t>(sz - 1);
+        std::vector<int32_t> plookup(sz);
+        std::iota(plookup.begin(), plookup.end(), 0);
+        for (uint32_t i = sz - 1; i > 0; i--)
         {
-            // Generate random lookup for permutations containing all numbers from 0..255
-            sz = 256;
-            permutations.resize(sz*2);
-            std::vector<uint8_t> plookup;
-            plookup.resize(sz);
-            std::iota(plookup.begin(), plookup.end(), 0);
-            std::default_random_engine rndEngine(std::random_device{}());
-            std::shuffle(plookup.begin(), plookup.end(), rndEngine);
-            
-            for (uint32_t i = 0; i < sz; i++)
-            {
-                permutations[i] = permutations[sz + i] = plookup[i];
-            }
+            std::swap(plookup[i], plookup[rndEngine() % (i + 1)]);
         }
-        else
+        
+        permutations.resize(sz * 2);
+        for (uint32_t i = 0; i < sz; i++)
         {
-            // Generate random lookup for permutations containing all numbers from 0..65535
-            sz = 65536;
-            permutations.resize(sz*2);
-            std::vector<uint16_t> plookup;
-            plookup.resize(sz);
-            std::iota(plookup.begin(), plookup.end(), 0);
-            std::default_random_engine rndEngine(std::random_device{}());
-            std::shuffle(plookup.begin(), plookup.end(), rndEngine);
-
-            for (uint32_t i = 0; i < sz; i++)
-            {
-                permutations[i] = permutations[sz + i] = plookup[i];
-            }
+            permutations[i] = permutations[sz + i] = plookup[i];
         }
     }
     
-    T noise(T x, T y, T z)
+    template <typename L>
+    typename L::F noise(typename L::F x, float y, float z) const
     {
+        typedef typename L::F F;
+        typedef typename L::I I;
+        const int32_t* p = permutations.data();
+        
         // Find unit cube that contains point
-        uint32_t sz = _texformat == RStextureFormat::tfUnsignedBytes ? 255 : 65535;
-        int32_t X = (int32_t)floor(x) & sz;
-        int32_t Y = (int32_t)floor(y) & sz;
-        int32_t Z = (int32_t)floor(z) & sz;
+        const F floorX = L::floor(x);
+        const float floorY = std::floor(y);
+        const float floorZ = std::floor(z);
+        const I X = L::andi(L::toInt(floorX), L::seti(_mask));
+        const I Y = L::seti(static_cast<int32_t>(floorY) & _mask);
+        const I Z = L::seti(static_cast<int32_t>(floorZ) & _mask);
         // Find relative x,y,z of point in cube
-        x -= floor(x);
-        y -= floor(y);
-        z -= floor(z);
-
+        const F fx = L::sub(x, floorX);
+        const F fy = L::set(y - floorY);
+        const F fz = L::set(z - floorZ);
+        const F one = L::set(1.0f);
+        
         // Compute fade curves for each of x,y,z
-        T u = fade(x);
-        T v = fade(y);
-        T w = fade(z);
-
+        const F u = fade<L>(fx);
+        const F v = L::set(fade<ScalarLanes>(y - floorY));
+        const F w = L::set(fade<ScalarLanes>(z - floorZ));
+        
         // Hash coordinates of the 8 cube corners
-        uint32_t A = permutations[X] + Y;
-        uint32_t AA = permutations[A] + Z;
-        uint32_t AB = permutations[A + 1] + Z;
-        uint32_t B = permutations[X + 1] + Y;
-        uint32_t BA = permutations[B] + Z;
-        uint32_t BB = permutations[B + 1] + Z;
-
+        const I onei = L::seti(1);
+        const I A = L::addi(L::gather(p, X), Y);
+        const I AA = L::addi(L::gather(p, A), Z);
+        const I AB = L::addi(L::gather(p, L::addi(A, onei)), Z);
+        const I B = L::addi(L::gather(p, L::addi(X, onei)), Y);
+        const I BA = L::addi(L::gather(p, B), Z);
+        const I BB = L::addi(L::gather(p, L::addi(B, onei)), Z);
+        
         // And add blended results for 8 corners of the cube;
-        T res = lerp(w, lerp(v,
-            lerp(u, grad(permutations[AA], x, y, z), grad(permutations[BA], x - 1, y, z)), lerp(u, grad(permutations[AB], x, y - 1, z), grad(permutations[BB], x - 1, y - 1, z))),
-            lerp(v, lerp(u, grad(permutations[AA + 1], x, y, z - 1), grad(permutations[BA + 1], x - 1, y, z - 1)), lerp(u, grad(permutations[AB + 1], x, y - 1, z - 1), grad(permutations[BB + 1], x - 1, y - 1, z - 1))));
-        return res;
+        const F fx1 = L::sub(fx, one);
+        const F fy1 = L::sub(fy, one);
+        const F fz1 = L::sub(fz, one);
+        const F x0 = lerp<L>(v,
+            lerp<L>(u, grad<L>(L::gather(p, AA), fx, fy, fz), grad<L>(L::gather(p, BA), fx1, fy, fz)),
+            lerp<L>(u, grad<L>(L::gather(p, AB), fx, fy1, fz), grad<L>(L::gather(p, BB), fx1, fy1, fz)));
+        const F x1 = lerp<L>(v,
+            lerp<L>(u, grad<L>(L::gather(p, L::addi(AA, onei)), fx, fy, fz1), grad<L>(L::gather(p, L::addi(BA, onei)), fx1, fy, fz1)),
+            lerp<L>(u, grad<L>(L::gather(p, L::addi(AB, onei)), fx, fy1, fz1), grad<L>(L::gather(p, L::addi(BB, onei)), fx1, fy1, fz1)));
+        return lerp<L>(w, x0, x1);
     }
 };
 
-// Fractal noise generator based on perlin noise above
-template <typename T>
-class FractalNoise
+// Fractal noise of a row of voxels based on perlin noise above, wrapped into [0, 1). The row is padded to a multiple of the lanes.
+template <typename L>
+static void fractalNoiseRow(const PerlinNoise& perlinNoise, uint32_t width, float noiseScale, float y, float z, float* out)
 {
-    private:
-    PerlinNoise<float> perlinNoise;
-    uint32_t octaves;
-    T frequency;
-    T amplitude;
-    T persistence;
-    public:
-
-    FractalNoise(const PerlinNoise<T>& perlinNoise)
-    {
-        this->perlinNoise = perlinNoise;
-        octaves = 6;
-        persistence = (T)0.5;
-    }
-
-    T noise(T x, T y, T z)
+    static const uint32_t OCTAVES = 6;
+    static const float PERSISTENCE = 0.5f;
+    
+    const typename L::F widthLanes = L::set(static_cast<float>(width));
+    for (uint32_t x = 0; x < width; x += L::WIDTH)
     {
-        T sum = 0;
-        T frequency = (T)1;
-        T amplitude = (T)1;
-        T max = (T)0;
-        for (uint32_t i = 0; i < octaves; i++)
+        const typename L::F nx = L::mul(L::div(L::toFloat(L::iota(static_cast<int32_t>(x))), widthLanes), L::set(noiseScale));
+        typename L::F sum = L::set(0.0f);
+        float frequency = 1.0f;
+        float amplitude = 1.0f;
+        float max = 0.0f;
+        for (uint32_t i = 0; i < OCTAVES; i++)
         {
-            sum += perlinNoise.noise(x * frequency, y * frequency, z * frequency) * amplitude;
+            const typename L::F n = perlinNoise.noise<L>(L::mul(nx, L::set(frequency)), y * frequency, z * frequency);
+            sum = L::add(sum, L::mul(n, L::set(amplitude)));
             max += amplitude;
-            amplitude *= persistence;
-            frequency *= (T)2;
+            amplitude *= PERSISTENCE;
+            frequency *= 2.0f;
         }
+        
+        sum = L::div(sum, L::set(max));
+        typename L::F n = L::div(L::add(sum, L::set(1.0f)), L::set(2.0f));
+        n = L::sub(n, L::floor(n));
+        L::store(out + x, n);
+    }
+}
 
-        sum = sum / max;
-        return (sum + (T)1.0) / (T)2.0;
+// Splits the slices [0, depth) across the hardware threads, the calling thread processes the first range
+template <typename Fn>
+static void forEachSliceRange(uint32_t depth, size_t voxelsPerSlice, const Fn& fn)
+{
+    static const size_t MIN_VOXELS_PER_THREAD = 64 * 1024;
+    const uint32_t numThreads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+    uint32_t numWorkers = static_cast<uint32_t>(voxelsPerSlice * depth / MIN_VOXELS_PER_THREAD) + 1;
+    numWorkers = numWorkers < numThreads ? numWorkers : numThreads;
+    numWorkers = numWorkers < depth ? numWorkers : depth;
+    
+    std::vector<std::thread> workers;
+    for (uint32_t w = 1; w < numWorkers; w++)
+    {
+        workers.emplace_back(fn, depth * w / numWorkers, depth * (w + 1) / numWorkers);
     }
-};
+    fn(0, depth / numWorkers);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
 
-RStextureInfo TextureLoader::create3Dvolume(uint32_t width, uint32_t height, uint32_t depth, RStextureFormat textureFormat)
+RStextureInfo TextureLoader::create3Dvolume(uint32_t width, uint32_t height, uint32_t depth, RStextureFormat textureFormat, uint32_t seed)
 {
     RStextureInfo texInfo;
     texInfo.width = width;
@@ -169,63 +315,57 @@ RStextureInfo TextureLoader::create3Dvolume(uint32_t width, uint32_t height, uin
     texInfo.textureType = RStextureType::ttTexture3D;
     texInfo.texelFormat = textureFormat;
     
-    const uint32_t texMemSize = texInfo.width * texInfo.height * texInfo.depth;
-    
+    const size_t texMemSize = static_cast<size_t>(texInfo.width) * texInfo.height * texInfo.depth;
     
     uint8_t* data8 = nullptr;
     uint16_t* data16 = nullptr;
-    std::string textureFormatStr = "Invalid";
     if(texInfo.texelFormat == RStextureFormat::tfUnsignedBytes)
     {
         data8 = new uint8_t[texMemSize];
-        memset(data8, 0, texMemSize);
-        textureFormatStr = " 8 bit";
     }
     else
     {
         data16 = new uint16_t[texMemSize];
-        memset(data16, 0, texMemSize);
-        textureFormatStr = " 16 bit";
     }
 
     // Generate perlin based noise
-    std::cout << "Generating " << texInfo.width << " x " << texInfo.height << " x " << texInfo.depth << textureFormatStr<<" noise volume..." << std::endl;
-
-    auto tStart = std::chrono::high_resolution_clock::now();
-    
-    PerlinNoise<float> perlinNoise(texInfo.texelFormat);
-    FractalNoise<float> fractalNoise(perlinNoise);
-
-    const float noiseScale = static_cast<float>(rand() % 10) + 4.0f;
+    std::mt19937 rndEngine(seed);
+    const PerlinNoise perlinNoise(texInfo.texelFormat, rndEngine);
+    const float noiseScale = static_cast<float>(rndEngine() % 10) + 4.0f;
     
-    for (uint32_t z = 0; z < texInfo.depth; z++)
+    // Every voxel is independent, so slabs of slices are generated in parallel and rows are vectorized along x
+    const uint32_t paddedWidth = (texInfo.width + NoiseLanes::WIDTH - 1) / NoiseLanes::WIDTH * NoiseLanes::WIDTH;
+    const auto generate = [&texInfo, &perlinNoise, noiseScale, paddedWidth, data8, data16](uint32_t zbegin, uint32_t zend)
     {
-        for (uint32_t y = 0; y < texInfo.height; y++)
+        std::vector<float> row(paddedWidth);
+        for (uint32_t z = zbegin; z < zend; z++)
         {
-            for (uint32_t x = 0; x < texInfo.width; x++)
+            for (uint32_t y = 0; y < texInfo.height; y++)
             {
-                float nx = (float)x / (float)texInfo.width;
-                float ny = (float)y / (float)texInfo.height;
-                float nz = (float)z / (float)texInfo.depth;
-#define FRACTAL
-#ifdef FRACTAL
-                float n = fractalNoise.noise(nx * noiseScale, ny * noiseScale, nz * noiseScale);
-#else
-                float n = 20.0 * perlinNoise.noise(nx, ny, nz);
-#endif
-                n = n - floor(n);
+                const float ny = (float)y / (float)texInfo.height;
+                const float nz = (float)z / (float)texInfo.depth;
+                fractalNoiseRow<NoiseLanes>(perlinNoise, texInfo.width, noiseScale, ny * noiseScale, nz * noiseScale, row.data());
                 
+                // Noise is in [0, 1), so truncation rounds down
+                const size_t rowOffset = (static_cast<size_t>(z) * texInfo.height + y) * texInfo.width;
                 if(texInfo.texelFormat == RStextureFormat::tfUnsignedBytes)
                 {
-                    data8[x + y * texInfo.width + z * texInfo.width * texInfo.height] = static_cast<uint8_t>(floor(n * 255));
+                    for (uint32_t x = 0; x < texInfo.width; x++)
+                    {
+                        data8[rowOffset + x] = static_cast<uint8_t>(row[x] * 255.0f);
+                    }
                 }
                 else
                 {
-                    data16[x + y * texInfo.width + z * texInfo.width * texInfo.height] = static_cast<uint16_t>(floor(n * 65535));
+                    for (uint32_t x = 0; x < texInfo.width; x++)
+                    {
+                        data16[rowOffset + x] = static_cast<uint16_t>(row[x] * 65535.0f);
+                    }
                 }
             }
         }
-    }
+    };
+    forEachSliceRange(texInfo.depth, static_cast<size_t>(texInfo.width) * texInfo.height, generate);
     
     if(texInfo.texelFormat == RStextureFormat::tfUnsignedBytes)
     {
@@ -235,14 +375,118 @@ RStextureInfo TextureLoader::create3Dvolume(uint32_t width, uint32_t height, uin
     {
         texInfo.texels = data16;
     }
-    auto tEnd = std::chrono::high_resolution_clock::now();
-    auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-
-    std::cout << "Done in " << tDiff << "ms" << std::endl;
 
     return texInfo;
 }
 
+// Reduces the slices [zbegin, zend) of the next coarser level. Each output row first reduces its four source rows voxel by voxel,
+// a loop over contiguous voxels the compiler vectorizes, and then folds the pairs along x.
+template <typename T>
+static void reduceSlices(const T* src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcDepth, T* dst, uint32_t dstWidth, uint32_t dstHeight, RSmipReduction reduction, uint32_t zbegin, uint32_t zend)
+{
+    // A single voxel wide axis reduces the same voxel twice
+    const uint32_t dx = srcWidth > 1 ? 1 : 0;
+    const size_t dy = srcHeight > 1 ? srcWidth : 0;
+    const size_t dz = srcDepth > 1 ? static_cast<size_t>(srcWidth) * srcHeight : 0;
+    const uint32_t rowWidth = dx ? 2 * dstWidth : 1;
+    
+    std::vector<uint32_t> sums(rowWidth);
+    std::vector<T> maxs(rowWidth);
+    for (uint32_t z = zbegin; z < zend; z++)
+    {
+        for (uint32_t y = 0; y < dstHeight; y++)
+        {
+            const T* r0 = src + (static_cast<size_t>(2 * z) * srcHeight + 2 * y) * srcWidth;
+            const T* r1 = r0 + dy;
+            const T* r2 = r0 + dz;
+            const T* r3 = r2 + dy;
+            T* out = dst + (static_cast<size_t>(z) * dstHeight + y) * dstWidth;
+            if (reduction == RSmipReduction::mrBox)
+            {
+                for (uint32_t i = 0; i < rowWidth; i++)
+                {
+                    sums[i] = static_cast<uint32_t>(r0[i]) + r1[i] + r2[i] + r3[i];
+                }
+                for (uint32_t x = 0; x < dstWidth; x++)
+                {
+                    out[x] = static_cast<T>((sums[2 * x] + sums[2 * x + dx] + 4) / 8);
+                }
+            }
+            else
+            {
+                for (uint32_t i = 0; i < rowWidth; i++)
+                {
+                    const T max01 = r0[i] > r1[i] ? r0[i] : r1[i];
+                    const T max23 = r2[i] > r3[i] ? r2[i] : r3[i];
+                    maxs[i] = max01 > max23 ? max01 : max23;
+                }
+                for (uint32_t x = 0; x < dstWidth; x++)
+                {
+                    out[x] = maxs[2 * x] > maxs[2 * x + dx] ? maxs[2 * x] : maxs[2 * x + dx];
+                }
+            }
+        }
+    }
+}
+
+RStextureInfo TextureLoader::create3Dpyramid(const RStextureInfo& volume, RSmipReduction reduction)
+{
+    assert(volume.textureType == RStextureType::ttTexture3D && volume.texels != nullptr && "pyramids are built from 3D volumes");
+    assert(volume.mipLevels == 1 && "the volume already has a pyramid");
+    assert((reduction == RSmipReduction::mrBox || reduction == RSmipReduction::mrMax) && "invalid mip reduction");
+    
+    struct Level
+    {
+        uint32_t width, height, depth;
+        size_t offset;
+    };
+    
+    const size_t texelSz = volume.texelFormat == RStextureFormat::tfUnsignedBytes ? 1 : 2;
+    std::vector<Level> levels;
+    Level level = { volume.width, volume.height, volume.depth, 0 };
+    size_t pyramidBytes = 0;
+    while (true)
+    {
+        levels.push_back(level);
+        pyramidBytes += static_cast<size_t>(level.width) * level.height * level.depth * texelSz;
+        if (level.width == 1 && level.height == 1 && level.depth == 1)
+        {
+            break;
+        }
+        level.width = level.width > 1 ? level.width / 2 : 1;
+        level.height = level.height > 1 ? level.height / 2 : 1;
+        level.depth = level.depth > 1 ? level.depth / 2 : 1;
+        level.offset = pyramidBytes;
+    }
+    
+    RStextureInfo pyramid = volume;
+    pyramid.mipLevels = static_cast<uint32_t>(levels.size());
+    uint8_t* texels = new uint8_t[pyramidBytes];
+    memcpy(texels, volume.texels, static_cast<size_t>(volume.width) * volume.height * volume.depth * texelSz);
+    pyramid.texels = texels;
+    
+    // Levels depend on the previous one, the slices of a level are split across the hardware threads
+    for (size_t l = 1; l < levels.size(); l++)
+    {
+        const Level& src = levels[l - 1];
+        const Level& dst = levels[l];
+        const auto reduce = [texels, texelSz, src, dst, reduction](uint32_t zbegin, uint32_t zend)
+        {
+            if (texelSz == 1)
+            {
+                reduceSlices<uint8_t>(texels + src.offset, src.width, src.height, src.depth, texels + dst.offset, dst.width, dst.height, reduction, zbegin, zend);
+            }
+            else
+            {
+                reduceSlices<uint16_t>(reinterpret_cast<uint16_t*>(texels + src.offset), src.width, src.height, src.depth, reinterpret_cast<uint16_t*>(texels + dst.offset), dst.width, dst.height, reduction, zbegin, zend);
+            }
+        };
+        forEachSliceRange(dst.depth, static_cast<size_t>(dst.width) * dst.height, reduce);
+    }
+    
+    return pyramid;
+}
+
 RStextureInfo TextureLoader::readTexture(const char* filepath) 
 {
     RStextureInfo ti;
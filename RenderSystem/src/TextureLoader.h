@@ -16,6 +16,7 @@ struct RStextureInfo
     uint32_t height = 1;
     uint32_t depth = 1;
     uint32_t numChannels = 4;
+    uint32_t mipLevels = 1; //levels stored back to back in texels, the finest first
 
     void dispose();
 };
@@ -33,9 +34,19 @@ class TextureLoader final
      * @param height the specified height of the volume
      * @param depth the specified depth of the volume
      * @param textureFormat the specified format of the voxel which can be 8 or 16 bit
+     * @param seed the specified seed of the noise, a seed generates the same voxels on every platform and thread count
      * @return the texture info including the voxel data.
      */
-    static RS_EXPORT RStextureInfo create3Dvolume(uint32_t width, uint32_t height, uint32_t depth, RStextureFormat textureFormat);
+    static RS_EXPORT RStextureInfo create3Dvolume(uint32_t width, uint32_t height, uint32_t depth, RStextureFormat textureFormat, uint32_t seed = 0);
+    
+    /**
+     * @brief Builds the full 3D mip pyramid of a single level 8 or 16 bit volume, down to a single voxel. Level sizes are halved
+     * and rounded down like Vulkan mip levels. The slices of each level are reduced on all hardware threads.
+     * @param volume the specified volume, left untouched
+     * @param reduction the specified reduction of 2x2x2 blocks, max keeps thin dense structures in CT visible
+     * @return the texture info of the pyramid, its texels are allocated with new uint8_t[] and owned by the caller.
+     */
+    static RS_EXPORT RStextureInfo create3Dpyramid(const RStextureInfo& volume, RSmipReduction reduction);
     
     /**
      * @brief Reads a 2D texture from a file on storage.
@@ -0,0 +1,323 @@
+#include "VkRSallocator.h"
+#include <stdexcept>
+#include <algorithm>
+#include <assert.h>
+
+void VkRSallocator::init(VkDevice device, VkPhysicalDevice physicalDevice)
+{
+    idevice = device;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &imemProperties);
+
+    VkPhysicalDeviceProperties deviceProperties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    ibufferImageGranularity = deviceProperties.limits.bufferImageGranularity;
+
+    //a pool per memory type, allocation type and resource kind (buffers and linear images or optimal images)
+    ipools.resize(imemProperties.memoryTypeCount * 4);
+    for (uint32_t memoryTypeIndex = 0; memoryTypeIndex < imemProperties.memoryTypeCount; memoryTypeIndex++)
+    {
+        const VkDeviceSize heapSize = imemProperties.memoryHeaps[imemProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+        for (uint32_t kind = 0; kind < 4; kind++)
+        {
+            Pool& pool = ipools[memoryTypeIndex * 4 + kind];
+            pool.memoryTypeIndex = memoryTypeIndex;
+            pool.type = (kind / 2) == 0 ? VkRSallocationType::atGeneral : VkRSallocationType::atTransient;
+            pool.blockSize = pool.type == VkRSallocationType::atGeneral ? GENERAL_BLOCK_SIZE : TRANSIENT_BLOCK_SIZE;
+
+            //small heaps, e.g. device local host visible memory, get smaller blocks
+            while (pool.blockSize > heapSize / 8 && pool.blockSize > MIN_ALLOCATION_SIZE * 4096)
+            {
+                pool.blockSize /= 2;
+            }
+        }
+    }
+}
+
+void VkRSallocator::dispose()
+{
+    for (Pool& pool : ipools)
+    {
+        for (std::unique_ptr<VkRSmemoryBlock>& block : pool.blocks)
+        {
+            if (block->mapped != nullptr)
+            {
+                vkUnmapMemory(idevice, block->memory);
+            }
+            vkFreeMemory(idevice, block->memory, nullptr);
+        }
+        pool.blocks.clear();
+    }
+    ipools.clear();
+}
+
+uint32_t VkRSallocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < imemProperties.memoryTypeCount; i++)
+    {
+        if (typeFilter & (1 << i) && (imemProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+uint32_t VkRSallocator::getPoolIndex(uint32_t memoryTypeIndex, VkRSallocationType type, bool optimalImage) const
+{
+    //buffers and optimal images only need separate blocks when they could otherwise share a granularity page
+    const uint32_t typeIndex = type == VkRSallocationType::atGeneral ? 0 : 1;
+    const uint32_t imageIndex = (optimalImage && ibufferImageGranularity > 1) ? 1 : 0;
+    return memoryTypeIndex * 4 + typeIndex * 2 + imageIndex;
+}
+
+VkRSmemoryBlock* VkRSallocator::createBlock(uint32_t poolIndex, VkDeviceSize size, bool dedicated)
+{
+    Pool& pool = ipools[poolIndex];
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = pool.memoryTypeIndex;
+
+    std::unique_ptr<VkRSmemoryBlock> block = std::make_unique<VkRSmemoryBlock>();
+    const VkResult res = vkAllocateMemory(idevice, &allocInfo, nullptr, &block->memory);
+    if (res != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate device memory block");
+    }
+
+    if (imemProperties.memoryTypes[pool.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        vkMapMemory(idevice, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+    }
+
+    block->size = size;
+    block->poolIndex = poolIndex;
+    block->dedicated = dedicated;
+    if (!dedicated && pool.type == VkRSallocationType::atGeneral)
+    {
+        //the whole block starts out as a single free range of the highest order
+        uint32_t maxOrder = 0;
+        while ((MIN_ALLOCATION_SIZE << maxOrder) < size)
+        {
+            maxOrder++;
+        }
+        block->freeLists.resize(maxOrder + 1);
+        block->freeLists[maxOrder].insert(0);
+    }
+
+    pool.blocks.push_back(std::move(block));
+    return pool.blocks.back().get();
+}
+
+void VkRSallocator::destroyBlock(VkRSmemoryBlock* block)
+{
+    Pool& pool = ipools[block->poolIndex];
+    if (block->mapped != nullptr)
+    {
+        vkUnmapMemory(idevice, block->memory);
+    }
+    vkFreeMemory(idevice, block->memory, nullptr);
+
+    const auto& iter = std::find_if(pool.blocks.begin(), pool.blocks.end(), [block](const std::unique_ptr<VkRSmemoryBlock>& b) { return b.get() == block; });
+    assert(iter != pool.blocks.end() && "memory block does not belong to its pool");
+    pool.blocks.erase(iter);
+}
+
+bool VkRSallocator::allocateBuddy(VkRSmemoryBlock& block, VkDeviceSize size, VkRSallocation& outAllocation)
+{
+    uint32_t order = 0;
+    while ((MIN_ALLOCATION_SIZE << order) < size)
+    {
+        order++;
+    }
+
+    const uint32_t numOrders = static_cast<uint32_t>(block.freeLists.size());
+    uint32_t freeOrder = order;
+    while (freeOrder < numOrders && block.freeLists[freeOrder].empty())
+    {
+        freeOrder++;
+    }
+    if (freeOrder >= numOrders)
+    {
+        return false;
+    }
+
+    //take the lowest free range and split it down, returning the upper halves to the free lists
+    const VkDeviceSize offset = *block.freeLists[freeOrder].begin();
+    block.freeLists[freeOrder].erase(block.freeLists[freeOrder].begin());
+    while (freeOrder > order)
+    {
+        freeOrder--;
+        block.freeLists[freeOrder].insert(offset + (MIN_ALLOCATION_SIZE << freeOrder));
+    }
+
+    outAllocation.offset = offset;
+    outAllocation.size = MIN_ALLOCATION_SIZE << order;
+    outAllocation.order = order;
+    return true;
+}
+
+void VkRSallocator::freeBuddy(VkRSmemoryBlock& block, VkDeviceSize offset, uint32_t order)
+{
+    const uint32_t maxOrder = static_cast<uint32_t>(block.freeLists.size()) - 1;
+    while (order < maxOrder)
+    {
+        const VkDeviceSize buddy = offset ^ (MIN_ALLOCATION_SIZE << order);
+        if (block.freeLists[order].erase(buddy) == 0)
+        {
+            break;
+        }
+        offset = offset < buddy ? offset : buddy;
+        order++;
+    }
+    block.freeLists[order].insert(offset);
+}
+
+bool VkRSallocator::allocateLinear(VkRSmemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkRSallocation& outAllocation)
+{
+    const VkDeviceSize offset = (block.head + alignment - 1) / alignment * alignment;
+    if (offset + size > block.size)
+    {
+        return false;
+    }
+
+    block.head = offset + size;
+    outAllocation.offset = offset;
+    outAllocation.size = size;
+    return true;
+}
+
+VkRSallocation VkRSallocator::allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, VkRSallocationType type, bool optimalImage)
+{
+    const uint32_t memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    const uint32_t poolIndex = getPoolIndex(memoryTypeIndex, type, optimalImage);
+    Pool& pool = ipools[poolIndex];
+
+    const VkDeviceSize alignment = memRequirements.alignment > 0 ? memRequirements.alignment : 1;
+    //buddy ranges are aligned to their size, so rounding up to the alignment aligns the offset too
+    const VkDeviceSize buddySize = memRequirements.size > alignment ? memRequirements.size : alignment;
+
+    VkRSallocation allocation;
+    const bool isGeneral = type == VkRSallocationType::atGeneral;
+    const bool fitsInBlock = isGeneral ? buddySize <= pool.blockSize / 2 : memRequirements.size <= pool.blockSize;
+    if (!fitsInBlock)
+    {
+        //large resources get a block of their own rather than wasting most of a shared one
+        VkRSmemoryBlock* block = createBlock(poolIndex, memRequirements.size, true);
+        allocation.block = block;
+        allocation.size = memRequirements.size;
+    }
+    else
+    {
+        for (std::unique_ptr<VkRSmemoryBlock>& block : pool.blocks)
+        {
+            const bool success = isGeneral ? allocateBuddy(*block, buddySize, allocation) : allocateLinear(*block, memRequirements.size, alignment, allocation);
+            if (success)
+            {
+                allocation.block = block.get();
+                break;
+            }
+        }
+
+        if (allocation.block == nullptr)
+        {
+            VkRSmemoryBlock* block = createBlock(poolIndex, pool.blockSize, false);
+            const bool success = isGeneral ? allocateBuddy(*block, buddySize, allocation) : allocateLinear(*block, memRequirements.size, alignment, allocation);
+            assert(success && "allocation does not fit a new memory block");
+            allocation.block = block;
+        }
+    }
+
+    VkRSmemoryBlock& block = *allocation.block;
+    block.numAllocations++;
+    block.bytesUsed += allocation.size;
+    allocation.memory = block.memory;
+    allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + allocation.offset : nullptr;
+    return allocation;
+}
+
+void VkRSallocator::free(VkRSallocation& allocation)
+{
+    VkRSmemoryBlock* block = allocation.block;
+    if (block == nullptr)
+    {
+        return;
+    }
+
+    block->numAllocations--;
+    block->bytesUsed -= allocation.size;
+    if (block->dedicated)
+    {
+        destroyBlock(block);
+    }
+    else
+    {
+        Pool& pool = ipools[block->poolIndex];
+        if (pool.type == VkRSallocationType::atGeneral)
+        {
+            freeBuddy(*block, allocation.offset, allocation.order);
+        }
+        else if (block->numAllocations == 0)
+        {
+            block->head = 0;
+        }
+
+        //keep one empty block per pool around so that alternating create and dispose does not thrash vkAllocateMemory,
+        //dedicated blocks are not shared and do not count
+        if (block->numAllocations == 0)
+        {
+            const auto numSharedBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const std::unique_ptr<VkRSmemoryBlock>& b) { return !b->dedicated; });
+            if (numSharedBlocks > 1)
+            {
+                destroyBlock(block);
+            }
+        }
+    }
+
+    allocation = VkRSallocation();
+}
+
+RSmemoryStats VkRSallocator::getStats() const
+{
+    RSmemoryStats stats;
+    VkDeviceSize totalFree = 0;
+    VkDeviceSize largestFree = 0;
+    for (const Pool& pool : ipools)
+    {
+        for (const std::unique_ptr<VkRSmemoryBlock>& block : pool.blocks)
+        {
+            stats.numBlocks++;
+            stats.numAllocations += block->numAllocations;
+            stats.bytesReserved += block->size;
+            stats.bytesUsed += block->bytesUsed;
+            if (block->dedicated)
+            {
+                continue;
+            }
+
+            VkDeviceSize blockLargestFree = 0;
+            if (pool.type == VkRSallocationType::atGeneral)
+            {
+                for (uint32_t order = 0; order < block->freeLists.size(); order++)
+                {
+                    if (!block->freeLists[order].empty())
+                    {
+                        blockLargestFree = MIN_ALLOCATION_SIZE << order;
+                    }
+                }
+                totalFree += block->size - block->bytesUsed;
+            }
+            else
+            {
+                blockLargestFree = block->size - block->head;
+                totalFree += blockLargestFree;
+            }
+            largestFree = blockLargestFree > largestFree ? blockLargestFree : largestFree;
+        }
+    }
+
+    stats.fragmentation = totalFree > 0 ? 1.0f - static_cast<float>(largestFree) / static_cast<float>(totalFree) : 0.0f;
+    return stats;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <set>
+#include <memory>
+#include "RSdataTypes.h"
+
+/**
+ * @brief How an allocation is placed within the memory blocks of the allocator.
+ */
+enum class VkRSallocationType
+{
+    atGeneral, //long lived buffers and images, buddy allocated
+    atTransient //short lived staging buffers, bump allocated and reclaimed when the whole block is free
+};
+
+struct VkRSmemoryBlock;
+
+/**
+ * @brief A range of device memory handed out by VkRSallocator. Resources bind to memory at offset.
+ */
+struct VkRSallocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr; //valid for host visible memory, blocks stay mapped for their lifetime
+
+    //bookkeeping of the allocator
+    VkRSmemoryBlock* block = nullptr;
+    uint32_t order = 0;
+};
+
+/**
+ * @brief A device memory block and the state of the allocator placing allocations inside it.
+ */
+struct VkRSmemoryBlock
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+    uint32_t poolIndex = 0;
+    bool dedicated = false;
+
+    //buddy allocator: offsets of free ranges of MIN_ALLOCATION_SIZE << order bytes, per order
+    std::vector<std::set<VkDeviceSize>> freeLists;
+
+    //linear allocator
+    VkDeviceSize head = 0;
+
+    uint32_t numAllocations = 0;
+    VkDeviceSize bytesUsed = 0;
+};
+
+/**
+ * @brief Sub-allocates buffers and images from large device memory blocks, one set of blocks per memory type and allocation
+ * type. Buffers and optimally tiled images are kept in separate blocks when bufferImageGranularity requires it.
+ */
+class VkRSallocator final
+{
+private:
+    static const VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+    static const VkDeviceSize GENERAL_BLOCK_SIZE = 64ull * 1024 * 1024;
+    static const VkDeviceSize TRANSIENT_BLOCK_SIZE = 32ull * 1024 * 1024;
+
+    struct Pool
+    {
+        uint32_t memoryTypeIndex = 0;
+        VkRSallocationType type = VkRSallocationType::atGeneral;
+        VkDeviceSize blockSize = 0;
+        std::vector<std::unique_ptr<VkRSmemoryBlock>> blocks;
+    };
+
+    VkDevice idevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties imemProperties{};
+    VkDeviceSize ibufferImageGranularity = 1;
+    std::vector<Pool> ipools;
+
+    uint32_t getPoolIndex(uint32_t memoryTypeIndex, VkRSallocationType type, bool optimalImage) const;
+    VkRSmemoryBlock* createBlock(uint32_t poolIndex, VkDeviceSize size, bool dedicated);
+    void destroyBlock(VkRSmemoryBlock* block);
+    bool allocateBuddy(VkRSmemoryBlock& block, VkDeviceSize size, VkRSallocation& outAllocation);
+    void freeBuddy(VkRSmemoryBlock& block, VkDeviceSize offset, uint32_t order);
+    bool allocateLinear(VkRSmemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkRSallocation& outAllocation);
+
+public:
+    /**
+     * @brief Initializes the allocator for a logical device.
+     * @param device the logical device memory is allocated from
+     * @param physicalDevice the physical device providing memory types and limits
+     */
+    void init(VkDevice device, VkPhysicalDevice physicalDevice);
+
+    /**
+     * @brief Frees all memory blocks. Every allocation must have been freed or be no longer in use.
+     */
+    void dispose();
+
+    /**
+     * @brief Finds a memory type satisfying the type filter and property flags.
+     * @return the memory type index, throws if none is available
+     */
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+    /**
+     * @brief Allocates memory for a resource.
+     * @param memRequirements the requirements of the buffer or image
+     * @param properties the required memory property flags
+     * @param type the allocation type, transient for short lived staging buffers
+     * @param optimalImage true for optimally tiled images, which must not share pages with buffers
+     * @return the allocation, throws on failure
+     */
+    VkRSallocation allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, VkRSallocationType type, bool optimalImage);
+
+    /**
+     * @brief Returns an allocation to its block. Empty blocks are released except for one per pool.
+     * @param allocation the allocation, reset on return
+     */
+    void free(VkRSallocation& allocation);
+
+    /**
+     * @brief Gathers usage statistics across all blocks.
+     * @return the memory statistics
+     */
+    RSmemoryStats getStats() const;
+};
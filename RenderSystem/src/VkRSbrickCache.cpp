@@ -0,0 +1,222 @@
+#include "VkRSbrickCache.h"
+#include <algorithm>
+#include <assert.h>
+
+void VkRSbrickCache::init(const glm::uvec3& volumeSize, uint32_t brickSize, const glm::uvec3& slotGrid)
+{
+    assert(brickSize > 0 && "brick size must not be 0");
+    assert(slotGrid.x > 0 && slotGrid.y > 0 && slotGrid.z > 0 && "the atlas needs at least one slot");
+
+    ivolumeSize = volumeSize;
+    ibrickSize = brickSize;
+    igridSize = (volumeSize + brickSize - 1u) / brickSize;
+    islotGrid = slotGrid;
+
+    ipageTable.assign(getNumBricks(), NOT_RESIDENT);
+    islotBricks.assign(getNumSlots(), INVALID_BRICK);
+    islotLastUsed.assign(getNumSlots(), 0);
+    ilruPrev.resize(getNumSlots());
+    ilruNext.resize(getNumSlots());
+    for (uint32_t slot = 0; slot < getNumSlots(); slot++)
+    {
+        ilruPrev[slot] = slot > 0 ? slot - 1 : INVALID_SLOT;
+        ilruNext[slot] = slot + 1 < getNumSlots() ? slot + 1 : INVALID_SLOT;
+    }
+    ilruHead = 0;
+    ilruTail = getNumSlots() - 1;
+    idirtyBricks.clear();
+}
+
+const glm::uvec3& VkRSbrickCache::getGridSize() const
+{
+    return igridSize;
+}
+
+const glm::uvec3& VkRSbrickCache::getSlotGrid() const
+{
+    return islotGrid;
+}
+
+uint32_t VkRSbrickCache::getBrickSize() const
+{
+    return ibrickSize;
+}
+
+uint32_t VkRSbrickCache::getNumBricks() const
+{
+    return igridSize.x * igridSize.y * igridSize.z;
+}
+
+uint32_t VkRSbrickCache::getNumSlots() const
+{
+    return islotGrid.x * islotGrid.y * islotGrid.z;
+}
+
+RSvolumeChunk VkRSbrickCache::getBrickRegion(uint32_t brick) const
+{
+    const glm::uvec3 coord(brick % igridSize.x, (brick / igridSize.x) % igridSize.y, brick / (igridSize.x * igridSize.y));
+    const glm::uvec3 start = coord * ibrickSize;
+    const glm::uvec3 end = glm::min(start + ibrickSize, ivolumeSize);
+    RSvolumeChunk region;
+    region.xoffset = static_cast<int32_t>(start.x);
+    region.yoffset = static_cast<int32_t>(start.y);
+    region.zoffset = static_cast<int32_t>(start.z);
+    region.xcount = end.x - start.x;
+    region.ycount = end.y - start.y;
+    region.zcount = end.z - start.z;
+    return region;
+}
+
+glm::uvec3 VkRSbrickCache::getSlotOffset(uint32_t slot) const
+{
+    const glm::uvec3 coord(slot % islotGrid.x, (slot / islotGrid.x) % islotGrid.y, slot / (islotGrid.x * islotGrid.y));
+    return coord * ibrickSize;
+}
+
+void VkRSbrickCache::getSliceBricks(const glm::uvec3& planes, std::vector<uint32_t>& outBricks) const
+{
+    outBricks.clear();
+    std::vector<bool> included(getNumBricks(), false);
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        const uint32_t plane = planes[axis] < ivolumeSize[axis] ? planes[axis] : ivolumeSize[axis] - 1;
+        const uint32_t first = (plane > 0 ? plane - 1 : plane) / ibrickSize;
+        const uint32_t last = (plane + 1 < ivolumeSize[axis] ? plane + 1 : plane) / ibrickSize;
+
+        //the two axes spanning the plane
+        const uint32_t u = (axis + 1) % 3;
+        const uint32_t v = (axis + 2) % 3;
+        for (uint32_t layer = first; layer <= last; layer++)
+        {
+            for (uint32_t j = 0; j < igridSize[v]; j++)
+            {
+                for (uint32_t i = 0; i < igridSize[u]; i++)
+                {
+                    glm::uvec3 coord;
+                    coord[axis] = layer;
+                    coord[u] = i;
+                    coord[v] = j;
+                    const uint32_t brick = coord.x + igridSize.x * (coord.y + igridSize.y * coord.z);
+                    if (!included[brick])
+                    {
+                        included[brick] = true;
+                        outBricks.push_back(brick);
+                    }
+                }
+            }
+        }
+    }
+
+    //bricks around the point all three planes go through come first
+    std::vector<std::pair<uint64_t, uint32_t>> distances;
+    distances.reserve(outBricks.size());
+    for (uint32_t brick : outBricks)
+    {
+        const RSvolumeChunk region = getBrickRegion(brick);
+        const glm::ivec3 center = glm::ivec3(region.xoffset, region.yoffset, region.zoffset) + glm::ivec3(region.xcount, region.ycount, region.zcount) / 2;
+        const glm::ivec3 delta = center - glm::ivec3(planes);
+        const int64_t dx = delta.x, dy = delta.y, dz = delta.z;
+        const uint64_t distance = static_cast<uint64_t>(dx * dx + dy * dy + dz * dz);
+        distances.push_back(std::make_pair(distance, brick));
+    }
+    std::sort(distances.begin(), distances.end());
+    for (size_t i = 0; i < distances.size(); i++)
+    {
+        outBricks[i] = distances[i].second;
+    }
+}
+
+void VkRSbrickCache::touchSlot(uint32_t slot, uint64_t frameSerial)
+{
+    islotLastUsed[slot] = frameSerial;
+    if (slot == ilruTail)
+    {
+        return;
+    }
+
+    //unlink and append as the most recently used
+    if (slot == ilruHead)
+    {
+        ilruHead = ilruNext[slot];
+    }
+    else
+    {
+        ilruNext[ilruPrev[slot]] = ilruNext[slot];
+    }
+    ilruPrev[ilruNext[slot]] = ilruPrev[slot];
+    ilruPrev[slot] = ilruTail;
+    ilruNext[slot] = INVALID_SLOT;
+    ilruNext[ilruTail] = slot;
+    ilruTail = slot;
+}
+
+void VkRSbrickCache::setEntry(uint32_t brick, uint32_t entry)
+{
+    ipageTable[brick] = entry;
+    idirtyBricks.push_back(brick);
+}
+
+void VkRSbrickCache::request(const std::vector<uint32_t>& bricks, uint64_t frameSerial, uint64_t completedSerial, uint32_t maxLoads, std::vector<Load>& outLoads)
+{
+    outLoads.clear();
+
+    //resident bricks are touched first so that none of them is evicted for a brick of the same frame
+    for (uint32_t brick : bricks)
+    {
+        assert(brick < getNumBricks() && "brick is outside of the volume");
+        if (ipageTable[brick] != NOT_RESIDENT)
+        {
+            touchSlot(ipageTable[brick] - 1, frameSerial);
+        }
+    }
+
+    for (uint32_t brick : bricks)
+    {
+        if (outLoads.size() >= maxLoads)
+        {
+            break;
+        }
+        if (ipageTable[brick] != NOT_RESIDENT)
+        {
+            continue;
+        }
+
+        //slots are ordered by the frame last sampling them, so if the oldest is still in use every slot is
+        const uint32_t slot = ilruHead;
+        if (islotLastUsed[slot] > completedSerial)
+        {
+            break;
+        }
+
+        Load load;
+        load.brick = brick;
+        load.slot = slot;
+        load.evicted = islotBricks[slot];
+        if (load.evicted != INVALID_BRICK)
+        {
+            setEntry(load.evicted, NOT_RESIDENT);
+        }
+        islotBricks[slot] = brick;
+        setEntry(brick, slot + 1);
+        touchSlot(slot, frameSerial);
+        outLoads.push_back(load);
+    }
+}
+
+bool VkRSbrickCache::isResident(uint32_t brick) const
+{
+    return ipageTable[brick] != NOT_RESIDENT;
+}
+
+const std::vector<uint32_t>& VkRSbrickCache::getPageTable() const
+{
+    return ipageTable;
+}
+
+void VkRSbrickCache::takeDirtyBricks(std::vector<uint32_t>& outBricks)
+{
+    std::sort(idirtyBricks.begin(), idirtyBricks.end());
+    idirtyBricks.erase(std::unique(idirtyBricks.begin(), idirtyBricks.end()), idirtyBricks.end());
+    outBricks.swap(idirtyBricks);
+    idirtyBricks.clear();
+}
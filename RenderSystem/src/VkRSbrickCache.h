@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "RSdataTypes.h"
+
+/**
+ * @brief Page table and brick pool residency of a bricked volume. Bricks are placed into the slots of a brick pool atlas and
+ * recycled least recently used first, but never while a submitted frame may still sample them. Makes no Vulkan calls, so
+ * the residency logic can be exercised on the CPU alone.
+ */
+class VkRSbrickCache final
+{
+public:
+    static constexpr uint32_t NOT_RESIDENT = 0; //page table entry of a brick without a slot
+    static constexpr uint32_t INVALID_BRICK = ~0u;
+    static constexpr uint32_t INVALID_SLOT = ~0u;
+
+    /**
+     * @brief A brick to upload into a slot of the atlas.
+     */
+    struct Load
+    {
+        uint32_t brick = INVALID_BRICK;
+        uint32_t slot = 0;
+        uint32_t evicted = INVALID_BRICK; //brick that held the slot before
+    };
+
+private:
+    glm::uvec3 ivolumeSize = glm::uvec3(0);
+    glm::uvec3 igridSize = glm::uvec3(0);
+    glm::uvec3 islotGrid = glm::uvec3(0);
+    uint32_t ibrickSize = 0;
+    std::vector<uint32_t> ipageTable; //per brick, slot + 1 or NOT_RESIDENT
+    std::vector<uint32_t> islotBricks; //per slot, the brick it holds or INVALID_BRICK
+    std::vector<uint64_t> islotLastUsed; //per slot, serial of the latest frame sampling it
+    //slots linked by index, least recently used first, so that the cache stays valid when copied
+    std::vector<uint32_t> ilruPrev;
+    std::vector<uint32_t> ilruNext;
+    uint32_t ilruHead = INVALID_SLOT;
+    uint32_t ilruTail = INVALID_SLOT;
+    std::vector<uint32_t> idirtyBricks; //bricks whose page table entry changed since takeDirtyBricks
+
+    void touchSlot(uint32_t slot, uint64_t frameSerial);
+    void setEntry(uint32_t brick, uint32_t entry);
+
+public:
+    /**
+     * @brief Resets the cache, every brick starts out not resident and every slot free.
+     * @param volumeSize the volume dimensions in voxels
+     * @param brickSize the voxels along each side of a brick
+     * @param slotGrid the slots along each axis of the atlas
+     */
+    void init(const glm::uvec3& volumeSize, uint32_t brickSize, const glm::uvec3& slotGrid);
+
+    /** @brief Gets the bricks along each axis of the volume. */
+    const glm::uvec3& getGridSize() const;
+    /** @brief Gets the slots along each axis of the atlas. */
+    const glm::uvec3& getSlotGrid() const;
+    uint32_t getBrickSize() const;
+    uint32_t getNumBricks() const;
+    uint32_t getNumSlots() const;
+
+    /**
+     * @brief Gets the voxel region of a brick in the volume, bricks along the upper borders may be smaller than brickSize.
+     * @param brick the brick index, x fastest
+     * @return the region
+     */
+    RSvolumeChunk getBrickRegion(uint32_t brick) const;
+
+    /**
+     * @brief Gets the voxel offset of a slot in the atlas.
+     * @param slot the slot index, x fastest
+     * @return the offset
+     */
+    glm::uvec3 getSlotOffset(uint32_t slot) const;
+
+    /**
+     * @brief Gathers the bricks that the sagittal, coronal and axial planes through a voxel intersect, nearest to the voxel
+     * first. Bricks next to a plane lying on a brick border are included since sampling may round into them.
+     * @param planes the sagittal, coronal and axial offsets of the planes
+     * @param outBricks the bricks, cleared first
+     */
+    void getSliceBricks(const glm::uvec3& planes, std::vector<uint32_t>& outBricks) const;
+
+    /**
+     * @brief Marks bricks as sampled by a frame and assigns slots to the ones not resident, in the order given. A slot is
+     * only recycled once every frame that sampled it has completed, so fewer loads than requested may be returned.
+     * @param bricks the bricks the frame samples
+     * @param frameSerial the serial of the frame
+     * @param completedSerial the serial of the latest completed frame
+     * @param maxLoads the maximum number of loads to return
+     * @param outLoads the loads, cleared first. The page table reports the bricks as resident right away, the caller
+     * uploads them before the page table changes become visible
+     */
+    void request(const std::vector<uint32_t>& bricks, uint64_t frameSerial, uint64_t completedSerial, uint32_t maxLoads, std::vector<Load>& outLoads);
+
+    /** @brief Checks whether a brick holds a slot. */
+    bool isResident(uint32_t brick) const;
+
+    /** @brief Gets the page table, one entry per brick. */
+    const std::vector<uint32_t>& getPageTable() const;
+
+    /**
+     * @brief Gets the bricks whose page table entries changed since the last call, in ascending order.
+     * @param outBricks the bricks, cleared first
+     */
+    void takeDirtyBricks(std::vector<uint32_t>& outBricks);
+};
@@ -1,11 +1,12 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include "VkRSallocator.h"
 
 struct VkRSbuffer {
     VkDevice device = VK_NULL_HANDLE;
     VkBuffer buffer = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkRSallocation memory;
 //    VkDescriptorBufferInfo descriptor{};
     VkDeviceSize size = 0;
     VkDeviceSize alignment = 0;
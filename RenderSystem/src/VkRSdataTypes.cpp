@@ -1,15 +1,35 @@
 
 #include "VkRSdataTypes.h"
+#include <algorithm>
+#include <tuple>
 
-VkFormat getVkFormat(const RSvertexAttribute& va) {
-    switch (va) {
-        case RSvertexAttribute::vaPosition:
-        case RSvertexAttribute::vaColor:
-        case RSvertexAttribute::vaNormal:
-            return VK_FORMAT_R32G32B32A32_SFLOAT;
+VkFormat getVkFormat(const RSvertexAttribute& va, const RSvertexFormat& format) {
+    //every format used here is mandatory for vertex buffers
+    const bool texcoord = va == RSvertexAttribute::vaTexCoord;
+    switch (format) {
+        case RSvertexFormat::vfFloat:
+            return texcoord ? VK_FORMAT_R32G32_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT;
 
-        case RSvertexAttribute::vaTexCoord:
-            return VK_FORMAT_R32G32_SFLOAT;
+        case RSvertexFormat::vfHalf:
+            return texcoord ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+
+        case RSvertexFormat::vfSnorm16:
+            if (va == RSvertexAttribute::vaPosition || va == RSvertexAttribute::vaNormal) {
+                return VK_FORMAT_R16G16B16A16_SNORM;
+            }
+            break;
+
+        case RSvertexFormat::vfOctahedral:
+            if (va == RSvertexAttribute::vaNormal) {
+                return VK_FORMAT_R16G16_SNORM;
+            }
+            break;
+
+        case RSvertexFormat::vfUnorm8:
+            if (va == RSvertexAttribute::vaColor) {
+                return VK_FORMAT_R8G8B8A8_UNORM;
+            }
+            break;
 
         default:
             break;
@@ -18,15 +38,127 @@ VkFormat getVkFormat(const RSvertexAttribute& va) {
     return VkFormat::VK_FORMAT_MAX_ENUM;
 }
 
-uint32_t getOffset(uint32_t numAttribs, uint32_t idx) {
+uint32_t getOffset(const RSvertexAttribsInfo& attribInfo, uint32_t idx) {
     uint32_t curroffset = 0;
-    for (size_t i = 0; i < numAttribs; i++) {
+    for (uint32_t i = 0; i < attribInfo.numVertexAttribs; i++) {
         if (idx == i) {
             return curroffset;
         }
 
-        curroffset += sizeof(glm::vec4);
+        curroffset += attribInfo.sizeOfAttrib(attribInfo.attributes[i]);
     }
 
     return curroffset;
 }
+
+void VkRSdirtyRanges::write(VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    VkDeviceSize begin = offset;
+    VkDeviceSize end = offset + size;
+
+    //find the first range ending at or after the new one starts, ranges never overlap each other
+    auto iter = ranges.upper_bound(begin);
+    if (iter != ranges.begin()) {
+        auto prev = std::prev(iter);
+        if (prev->first + prev->second.size() >= begin) {
+            iter = prev;
+        }
+    }
+
+    //merge every range touching [begin, end) into one
+    std::vector<std::pair<VkDeviceSize, std::vector<uint8_t>>> merged;
+    while (iter != ranges.end() && iter->first <= end) {
+        begin = iter->first < begin ? iter->first : begin;
+        const VkDeviceSize rangeEnd = iter->first + iter->second.size();
+        end = rangeEnd > end ? rangeEnd : end;
+        merged.emplace_back(iter->first, std::move(iter->second));
+        iter = ranges.erase(iter);
+    }
+
+    std::vector<uint8_t> bytes(static_cast<size_t>(end - begin));
+    for (const auto& range : merged) {
+        std::memcpy(bytes.data() + (range.first - begin), range.second.data(), range.second.size());
+    }
+    std::memcpy(bytes.data() + (offset - begin), data, static_cast<size_t>(size));
+    ranges[begin] = std::move(bytes);
+}
+
+bool VkRSpipelineKey::operator==(const VkRSpipelineKey& other) const {
+    return shaderTemplate == other.shaderTemplate && instanced == other.instanced && settings == other.settings && attributes == other.attributes &&
+        formats == other.formats && topology == other.topology && depthFunc == other.depthFunc && lineWidth == other.lineWidth &&
+        appearanceLayout == other.appearanceLayout && renderPass == other.renderPass;
+}
+
+bool VkRSpipelineKey::isCompatible(const VkRSpipelineKey& other) const {
+    return shaderTemplate == other.shaderTemplate && instanced == other.instanced && settings == other.settings && attributes == other.attributes &&
+        formats == other.formats && topology == other.topology && depthFunc == other.depthFunc && appearanceLayout == other.appearanceLayout &&
+        renderPass == other.renderPass;
+}
+
+static void hashCombine(size_t& seed, size_t value) {
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+size_t VkRSpipelineKeyHasher::operator()(const VkRSpipelineKey& key) const {
+    size_t seed = 0;
+    hashCombine(seed, static_cast<size_t>(key.shaderTemplate));
+    hashCombine(seed, static_cast<size_t>(key.instanced));
+    hashCombine(seed, static_cast<size_t>(key.settings));
+    for (size_t i = 0; i < key.attributes.size(); i++) {
+        hashCombine(seed, static_cast<size_t>(key.attributes[i]));
+        hashCombine(seed, static_cast<size_t>(key.formats[i]));
+    }
+    hashCombine(seed, static_cast<size_t>(key.topology));
+    hashCombine(seed, static_cast<size_t>(key.depthFunc));
+    hashCombine(seed, std::hash<float>()(key.lineWidth));
+    hashCombine(seed, std::hash<VkDescriptorSetLayout>()(key.appearanceLayout));
+    hashCombine(seed, std::hash<VkRenderPass>()(key.renderPass));
+    return seed;
+}
+
+RSvolumeChunk VkRSvolumeStream::getBrickRegion(uint32_t brick, const glm::uvec3& dimensions) const {
+    const glm::uvec3 coord(brick % gridSize.x, (brick / gridSize.x) % gridSize.y, brick / (gridSize.x * gridSize.y));
+    const glm::uvec3 start = coord * brickSize;
+    const glm::uvec3 end = glm::min(start + brickSize, dimensions);
+    RSvolumeChunk region;
+    region.xoffset = static_cast<int32_t>(start.x);
+    region.yoffset = static_cast<int32_t>(start.y);
+    region.zoffset = static_cast<int32_t>(start.z);
+    region.xcount = end.x - start.x;
+    region.ycount = end.y - start.y;
+    region.zcount = end.z - start.z;
+    return region;
+}
+
+static uint32_t distanceToPlane(int32_t offset, uint32_t count, uint32_t plane) {
+    const uint32_t start = static_cast<uint32_t>(offset);
+    if (plane < start) {
+        return start - plane;
+    }
+    return plane >= start + count ? plane - (start + count - 1) : 0;
+}
+
+void VkRSvolumeStream::sortPending(const glm::uvec3& dimensions) {
+    //a brick is needed as soon as one of the slice planes cuts through it, so the nearest plane decides, then the others
+    std::vector<std::pair<glm::uvec2, uint32_t>> priorities;
+    priorities.reserve(pending.size());
+    for (uint32_t brick : pending) {
+        const RSvolumeChunk region = getBrickRegion(brick, dimensions);
+        const uint32_t dx = distanceToPlane(region.xoffset, region.xcount, focus.x);
+        const uint32_t dy = distanceToPlane(region.yoffset, region.ycount, focus.y);
+        const uint32_t dz = distanceToPlane(region.zoffset, region.zcount, focus.z);
+        const uint32_t nearest = dx < dy ? (dx < dz ? dx : dz) : (dy < dz ? dy : dz);
+        priorities.push_back(std::make_pair(glm::uvec2(nearest, dx + dy + dz), brick));
+    }
+    
+    //pending bricks are taken from the back
+    std::sort(priorities.begin(), priorities.end(), [](const std::pair<glm::uvec2, uint32_t>& a, const std::pair<glm::uvec2, uint32_t>& b) {
+        return std::tie(a.first.x, a.first.y, a.second) > std::tie(b.first.x, b.first.y, b.second);
+    });
+    for (size_t i = 0; i < priorities.size(); i++) {
+        pending[i] = priorities[i].second;
+    }
+}
+
+bool VkRSvolumeStream::isResident(uint32_t brick) const {
+    return (residency[brick / 32] & (1u << (brick % 32))) != 0;
+}
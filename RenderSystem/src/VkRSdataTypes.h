@@ -12,20 +12,32 @@
 #include <optional>
 #include <array>
 #include <unordered_set>
+#include <functional>
+#include <map>
 #include "rsenums.h"
 #include "DrawCommand.h"
 #include "TextureLoader.h"
 #include "VkRSbuffer.h"
+#include "VkRSrangeAllocator.h"
+#include "VkRSbrickCache.h"
+
+struct VkRSview;
 
 struct VkRSqueueFamilyIndices 
 {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> transferFamily; //only set for a transfer family without graphics support
 
     bool isComplete() 
     {
         return graphicsFamily.has_value() && presentFamily.has_value();
     }
+
+    bool hasDedicatedTransfer() const
+    {
+        return transferFamily.has_value();
+    }
 };
 
 struct VkRSinstance 
@@ -43,7 +55,9 @@ struct VkRSinstance
     VkDevice device;
     VkQueue graphicsQueue{};
     VkQueue presentQueue{};
+    VkQueue transferQueue{}; //the graphics queue unless the device has a dedicated transfer family
     VkCommandPool commandPool{}; //manages the memory where command buffers are allocated from them
+    VkCommandPool transferCommandPool{}; //the command pool unless the device has a dedicated transfer family
     VkRSqueueFamilyIndices queueFamilyIndices;
     VkSurfaceFormatKHR surfaceFormat;
     
@@ -70,7 +84,9 @@ struct VkRSshader
 
 struct VkRScontext 
 {
-    static const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+    //upper bound of frames in flight, per frame resources are sized for it
+    static const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+    uint32_t framesInFlight = 2;
     VkSurfaceKHR surface{};
     bool resized = false;
     uint32_t width = 0;
@@ -83,6 +99,22 @@ struct VkRScontext
 };
 
 
+/**
+ * @brief Secondary command buffers recorded for one collection in one view, one per record chunk and frame in flight.
+ * Buffers are replayed as long as the collection version they were recorded against is unchanged.
+ */
+struct VkRScollectionCommands
+{
+    static const uint64_t INVALID_VERSION = UINT64_MAX;
+    
+    //indexed by chunk * MAX_FRAMES_IN_FLIGHT + frame
+    std::vector<VkCommandBuffer> commandBuffers;
+    //the command pool and recording worker of each chunk, buffers of a pool are only recorded by its worker
+    std::vector<VkCommandPool> chunkPools;
+    std::vector<uint32_t> chunkWorkers;
+    std::vector<uint64_t> recordedVersions;
+};
+
 struct VkRSview 
 {
     VkRenderPass renderPass{};
@@ -93,7 +125,7 @@ struct VkRSview
     VkFormat swapChainImageFormat{};
     VkExtent2D swapChainExtent{};
     VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
+    VkRSallocation depthImageMemory;
     VkImageView depthImageView;
     std::vector<VkCommandBuffer> commandBuffers; //gets automatically disposed when command pool is disposed.
     std::unordered_set<RScollectionID, IDHasher<RScollectionID>> collectionIDlist;
@@ -102,10 +134,14 @@ struct VkRSview
     VkDescriptorSetLayout descriptorSetLayout{};
     std::vector<VkDescriptorSet> descriptorSets;
     std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    std::vector<VkRSallocation> uniformBuffersMemory;
     std::vector<void*> uniformBuffersMapped;
     
-    std::unordered_map<RScollectionID, std::vector<RSinstanceID>, IDHasher<RScollectionID>> hiddenInstances;
+    std::unordered_map<RScollectionID, std::unordered_set<RSinstanceID, IDHasher<RSinstanceID>>, IDHasher<RScollectionID>> hiddenInstances;
+    //per collection bitset of hidden instances indexed by draw slot, derived from hiddenInstances.
+    std::unordered_map<RScollectionID, std::vector<uint64_t>, IDHasher<RScollectionID>> hiddenBits;
+    //cached secondary command buffers of the collections drawn in this view
+    std::unordered_map<RScollectionID, VkRScollectionCommands, IDHasher<RScollectionID>> collectionCommands;
 
     RSview view;
     uint32_t currentFrame = 0;
@@ -118,49 +154,163 @@ struct VkRSswapChainSupportDetails
     std::vector<VkPresentModeKHR> presentModes{};
 };
 
+/**
+ * @brief Streaming state of a progressively loaded 3D texture. The volume is split into a grid of bricks that are uploaded
+ * a few per frame, nearest to the focus first, and marked resident in the volume slice uniforms once their upload completes.
+ */
+struct VkRSvolumeStream
+{
+    static const uint32_t MAX_BRICKS = 1024; //residency bits in VkRSvolumeSliceDescriptor
+    glm::uvec3 gridSize = glm::uvec3(1); //bricks per axis
+    glm::uvec3 brickSize = glm::uvec3(1); //voxels per brick, the last brick along an axis may be smaller
+    glm::uvec3 focus = glm::uvec3(0); //sagittal, coronal and axial offset the bricks are streamed out from
+    std::vector<uint32_t> pending; //bricks not staged yet, nearest to the focus last
+    std::vector<std::pair<uint32_t, uint64_t>> inFlight; //staged bricks and the upload batch carrying them
+    std::array<uint32_t, MAX_BRICKS / 32> residency{};
+    
+    /** @brief Gets the voxel region of a brick. */
+    RSvolumeChunk getBrickRegion(uint32_t brick, const glm::uvec3& dimensions) const;
+    /** @brief Orders the pending bricks by their distance to the nearest of the three planes through the focus. */
+    void sortPending(const glm::uvec3& dimensions);
+    bool isResident(uint32_t brick) const;
+};
+
 struct VkRStexture 
 {
     RStextureInfo texinfo;
     std::string absPath;
     VkImage textureImage = VK_NULL_HANDLE;
-    VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+    VkRSallocation textureImageMemory;
     VkImageView textureImageView = VK_NULL_HANDLE;
     VkSampler textureSampler = VK_NULL_HANDLE;
+    VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; //streamed volumes are sampled while they are written
+    uint64_t uploadSerial = 0; //upload batch carrying the texels, the latest one of a streamed volume
+    bool streamed = false;
+    VkRSvolumeStream stream; //the focus also places the slice planes of a bricked volume
+    bool bricked = false; //the image is the brick pool atlas of the volume
+    VkRSbrickCache brickCache;
+    VkBuffer pageTableBuffer = VK_NULL_HANDLE;
+    VkRSallocation pageTableMemory;
+};
+
+/**
+ * @brief A large vertex or index buffer whose ranges are handed out to geometry data when shared geometry buffers are enabled.
+ */
+struct VkRSsharedGeometryBuffer
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkRSallocation memory;
+    VkRSrangeAllocator ranges;
+};
+
+/**
+ * @brief A range of a shared geometry buffer owned by a geometry data.
+ */
+struct VkRSgeometryRange
+{
+    uint32_t bufferIndex = UINT32_MAX;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+
+    bool isValid() const { return bufferIndex != UINT32_MAX; }
+};
+
+/**
+ * @brief Host visible memory an upload is staged in, a range of the staging ring or, when the ring cannot hold it,
+ * a buffer of its own.
+ */
+struct VkRSstagingRange
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+    VkRSallocation memory; //only set for a buffer of its own
+
+    bool isValid() const { return buffer != VK_NULL_HANDLE; }
+};
+
+/**
+ * @brief Bytes written to a finalized device buffer and not yet uploaded. Overlapping and adjacent writes are merged
+ * so that each run of dirty bytes costs a single copy, later writes replace the overlapped bytes of earlier ones.
+ */
+struct VkRSdirtyRanges
+{
+    std::map<VkDeviceSize, std::vector<uint8_t>> ranges; //offset to bytes
+
+    void write(VkDeviceSize offset, const void* data, VkDeviceSize size);
+    bool empty() const { return ranges.empty(); }
 };
 
 struct VkRSinterleavedGeomBuffers 
 {
     VkBuffer vaBuffer = VK_NULL_HANDLE;
-    VkBuffer stagingVABuffer = VK_NULL_HANDLE;
-    VkDeviceMemory vaBufferMemory = VK_NULL_HANDLE;
-    VkDeviceMemory stagingVAbufferMemory = VK_NULL_HANDLE;
-    void* mappedStagingVAPtr = nullptr;
+    VkRSgeometryRange vaRange;
+    VkRSallocation vaBufferMemory;
+    VkRSstagingRange staging;
+    VkRSdirtyRanges dirty;
 };
 
 struct VkRSseparateGeomBuffers 
 {
-    std::array<VkRSbuffer, 4> stagingBuffers;
+    std::array<VkRSstagingRange, 4> staging;
     std::array<VkRSbuffer, 4> buffers;
+    std::array<VkRSgeometryRange, 4> ranges;
+    std::array<VkRSdirtyRanges, 4> dirty;
 };
 
 struct VkRSindicesBuffers 
 {
     VkBuffer indicesBuffer = VK_NULL_HANDLE;
-    VkBuffer stagingIndexBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory indicesBufferMemory = VK_NULL_HANDLE;
-    VkDeviceMemory stagingIndexBufferMemory = VK_NULL_HANDLE;
-    void* mappedIndexPtr = nullptr;
+    VkRSgeometryRange indicesRange;
+    VkRSallocation indicesBufferMemory;
+    VkRSstagingRange staging;
+    VkRSdirtyRanges dirty;
 };
 
 struct VkRSgeometryData 
 {
     uint32_t numVertices = 0;
     uint32_t numIndices = 0;
+    RSindexType indexType = RSindexType::itUint32;
     RSvertexAttribsInfo attributesInfo;
+    //device buffers are ranges of the shared geometry buffers rather than buffers of their own
+    bool sharedBuffers = false;
+    bool finalized = false;
+    uint64_t uploadSerial = 0; //upload batch carrying the staged vertices and indices
+    
+    //dynamic and stream data lives in host visible buffers holding a copy per frame in flight plus the one being written. Draws
+    //bind the current copy while the client writes another, which becomes current once published at the next draw.
+    static const uint32_t NUM_COPIES = VkRScontext::MAX_FRAMES_IN_FLIGHT + 1;
+    static const uint32_t NO_COPY = UINT32_MAX;
+    static const VkDeviceSize COPY_ALIGNMENT = 256;
+    bool dynamicBuffers = false;
+    uint32_t currentCopy = 0;
+    uint32_t writeCopy = NO_COPY;
+    std::array<uint64_t, NUM_COPIES> copyReadSerials{}; //last submission that may read each copy
     
     VkRSinterleavedGeomBuffers interleaved;
     VkRSseparateGeomBuffers separate;
     VkRSindicesBuffers indices;
+
+    /**
+     * @brief Gets the size of a single index.
+     * @return the index size in bytes
+     */
+    VkDeviceSize indexSize() const 
+    {
+        return indexType == RSindexType::itUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+
+    /**
+     * @brief Gets the distance between the copies of a dynamic buffer.
+     * @param size the size of a single copy in bytes
+     * @return the aligned copy size
+     */
+    static VkDeviceSize copyStride(VkDeviceSize size) 
+    {
+        return (size + COPY_ALIGNMENT - 1) / COPY_ALIGNMENT * COPY_ALIGNMENT;
+    }
 };
 
 struct VkRSgeometry 
@@ -183,6 +333,27 @@ struct VkRScollection
 
     DrawCommands drawCommands;
     RSinstances instanceMap;
+    //flat copy of drawCommands sorted by pipeline, appearance, geometry data and state. Rebuilt on finalize.
+    std::vector<VkRSdrawCommand> drawList;
+    //maps an instance to its slot in drawList
+    std::unordered_map<RSinstanceID, uint32_t, IDHasher<RSinstanceID>> drawSlots;
+    //bitset of instances hidden via collectionInstanceHide, indexed by draw slot
+    std::vector<uint64_t> hiddenBits;
+    //consecutive runs of drawList, instanced or drawn one slot at a time
+    std::vector<VkRSdrawBatch> batches;
+    std::vector<VkRSrecordChunk> recordChunks;
+    
+    //per frame in flight storage buffers holding the spatial slots of the visible instances of instanced batches
+    std::vector<VkRSbuffer> instanceBuffers;
+    VkDescriptorPool instanceDescriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> instanceDescriptorSets;
+    //view whose visible slots were last written to instanceBuffers, per frame
+    std::vector<const VkRSview*> instanceSlotsWriters;
+    //bumped whenever recorded commands of this collection become stale: draw list rebuilt, instance hidden or dynamic
+    //geometry data published
+    uint64_t version = 0;
+    bool hasDynamicGeometry = false;
+    bool pipelinesPending = false; //some batches still wait for their pipeline or draw with a fallback
     bool dirty = true;
 };
 
@@ -197,6 +368,11 @@ struct VkRSvolumeSliceDescriptor
 {
     glm::vec2 window;
     glm::vec2 rescale;
+    glm::uvec4 brickGrid = glm::uvec4(0); //bricks per axis, w is 1 while a streamed volume streams in and 2 for a bricked volume
+    glm::vec4 brickScale = glm::vec4(1.0f); //texture coordinates to brick coordinates
+    std::array<uint32_t, VkRSvolumeStream::MAX_BRICKS / 32> residency{};
+    glm::uvec4 atlasGrid = glm::uvec4(0); //slots per axis of the brick pool atlas of a bricked volume, w is the brick size
+    glm::vec4 lod = glm::vec4(0.0f); //x is the bias of the level picked from the voxel density on screen, y the coarsest level
 };
 
 struct VkRSappearance 
@@ -208,7 +384,7 @@ struct VkRSappearance
 
     //used for volume slices currently - but can be generatlized later when we have different appearance types
     std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    std::vector<VkRSallocation> uniformBuffersMemory;
     std::vector<void*> uniformBuffersMapped;
 };
 
@@ -217,10 +393,139 @@ struct VkRSspatial
     RSspatial spatial;
 };
 
+/**
+ * @brief Vulkan objects disposed while frames in flight may still use them. They are destroyed once every
+ * submission made up to the disposal has completed.
+ */
+struct VkRSretiredObject
+{
+    uint64_t serial = 0; //the latest submission serial at disposal time
+    std::function<void()> destroy;
+};
+
+/**
+ * @brief A copy from staging memory into a device buffer the graphics family owns.
+ */
+struct VkRSbufferUpdate
+{
+    VkBuffer srcBuffer = VK_NULL_HANDLE;
+    VkBuffer dstBuffer = VK_NULL_HANDLE;
+    VkBufferCopy region{};
+};
+
+/**
+ * @brief Staging to device copies recorded into one command buffer and submitted together. Staging memory is
+ * released by the completion callbacks once the fence of the batch signals. The fence is signaled by the graphics
+ * queue after it acquired ownership of the written resources when the copies ran on a dedicated transfer queue.
+ */
+struct VkRSuploadBatch
+{
+    uint64_t serial = 0;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    VkDeviceSize stagingBytes = 0;
+
+    //with a dedicated transfer queue the copies are released by the transfer queue and acquired by the graphics queue
+    VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+    VkSemaphore transferComplete = VK_NULL_HANDLE;
+    std::vector<VkBufferMemoryBarrier> bufferAcquires;
+    std::vector<VkImageMemoryBarrier> imageAcquires;
+
+    //updates of finalized buffers, recorded on the graphics queue since the buffers are in use by frames
+    std::vector<VkRSbufferUpdate> updates;
+    std::vector<std::function<void()>> onComplete;
+};
+
+/**
+ * @brief Device copies of all spatials, one persistently mapped storage buffer per frame in flight indexed by spatial slot (the spatial ID).
+ * Each copy only receives the slots written since it was last flushed.
+ */
+struct VkRSspatialStore
+{
+    uint32_t capacity = 0;
+    std::vector<VkRSbuffer> buffers;
+    std::vector<std::vector<uint32_t>> dirtySlots;
+    std::vector<std::vector<uint64_t>> dirtyBits;
+};
+
+/**
+ * @brief Header of the pipeline cache file. Cache data is only used by the device and driver that wrote it.
+ */
+struct VkRSpipelineCacheHeader
+{
+    static const uint32_t MAGIC = 0x43505352; //RSPC
+    uint32_t magic = MAGIC;
+    uint32_t vendorID = 0;
+    uint32_t deviceID = 0;
+    uint32_t driverVersion = 0;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE] = {};
+    uint64_t dataSize = 0;
+};
+
+/**
+ * @brief Identifies a graphics pipeline by everything it is created from, so that draws with equal state share one.
+ */
+struct VkRSpipelineKey
+{
+    RSshaderTemplate shaderTemplate = RSshaderTemplate::stMax;
+    bool instanced = false;
+    RSvertexAttributeSettings settings = RSvertexAttributeSettings::vasInterleaved;
+    std::vector<RSvertexAttribute> attributes;
+    std::vector<RSvertexFormat> formats; //one per attribute
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    RSdepthFunction depthFunc = RSdepthFunction::dsLess;
+    float lineWidth = 1.0f;
+    VkDescriptorSetLayout appearanceLayout = VK_NULL_HANDLE; //shared by all appearances of a shader template through VkRSfactory
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+
+    bool operator==(const VkRSpipelineKey& other) const;
+    /** @brief Pipelines of compatible keys only differ in line width, so either can draw for the other without changing occlusion. */
+    bool isCompatible(const VkRSpipelineKey& other) const;
+};
+
+struct VkRSpipelineKeyHasher
+{
+    size_t operator()(const VkRSpipelineKey& key) const;
+};
+
+/**
+ * @brief A pipeline and its layout in the pipeline registry, shared by every draw created from the same key.
+ */
+struct VkRSpipeline
+{
+    VkPipeline pipeline = VK_NULL_HANDLE; //null until compiled
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    uint32_t refCount = 0;
+    bool ready = false;
+    VkRSpipeline* fallback = nullptr; //a ready compatible pipeline drawn with while this one compiles, referenced until then
+    const VkRSpipelineKey* key = nullptr; //key of this entry in the registry
+
+    /** @brief Gets the pipeline draws bind, null when neither it nor a fallback is ready. */
+    VkPipeline getBindable() const
+    {
+        if (ready)
+        {
+            return pipeline;
+        }
+        return fallback != nullptr ? fallback->pipeline : VK_NULL_HANDLE;
+    }
+};
+
+/**
+ * @brief A pipeline compiled by a pipeline thread, applied to its registry entry on the render thread.
+ */
+struct VkRSpipelineCompile
+{
+    VkRSpipeline* entry = nullptr;
+    VkPipeline pipeline = VK_NULL_HANDLE; //null if compiling failed
+    double milliseconds = 0.0;
+    bool cacheHit = false;
+};
+
 struct VkRSstate 
 {
     RSstate state{};
 };
 
-VkFormat getVkFormat(const RSvertexAttribute& va);
-uint32_t getOffset(uint32_t numAttribs, uint32_t idx);
+VkFormat getVkFormat(const RSvertexAttribute& va, const RSvertexFormat& format);
+uint32_t getOffset(const RSvertexAttribsInfo& attribInfo, uint32_t idx);
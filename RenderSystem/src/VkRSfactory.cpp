@@ -29,11 +29,20 @@ void VkRSfactory::createViewDefaultDescriptorLayout()
     uboLayoutBinding.descriptorCount = 1; //all view related parameters\data are sourced by one buffer
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
+    
+    VkDescriptorSetLayoutBinding spatialLayoutBinding{};
+    spatialLayoutBinding.binding = 1;
+    spatialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    spatialLayoutBinding.descriptorCount = 1; //the spatials of all instances live in one storage buffer
+    spatialLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    spatialLayoutBinding.pImmutableSamplers = nullptr;
+    
+    std::array<VkDescriptorSetLayoutBinding, 2> layoutBindings = { uboLayoutBinding, spatialLayoutBinding };
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &uboLayoutBinding;
+    layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+    layoutInfo.pBindings = layoutBindings.data();
 
     VkDescriptorSetLayout dsl;
     VkResult res = vkCreateDescriptorSetLayout(vkrsinst.device, &layoutInfo, nullptr, &dsl);
@@ -45,6 +54,101 @@ void VkRSfactory::createViewDefaultDescriptorLayout()
     _descriptorLayoutMap[DescriptorLayoutType::dltViewDefault] = dsl;
 }
 
+void VkRSfactory::createInstanceSlotsDescriptorLayout()
+{
+    auto& vkrs = VkRenderSystem::getInstance();
+    VkRSinstance vkrsinst = vkrs.getVkInstanceData();
+    
+    VkDescriptorSetLayoutBinding ssboLayoutBinding{};
+    ssboLayoutBinding.binding = 0;
+    ssboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    ssboLayoutBinding.descriptorCount = 1; //one buffer holds the spatial slots of all instanced draws in a collection
+    ssboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    ssboLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &ssboLayoutBinding;
+
+    VkDescriptorSetLayout dsl;
+    VkResult res = vkCreateDescriptorSetLayout(vkrsinst.device, &layoutInfo, nullptr, &dsl);
+    if (res != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create a descriptor set layout");
+    }
+    
+    _descriptorLayoutMap[DescriptorLayoutType::dltInstanceSlots] = dsl;
+}
+
+void VkRSfactory::createSimpleTexturedDescriptorLayout()
+{
+    auto& vkrs = VkRenderSystem::getInstance();
+    VkRSinstance vkrsinst = vkrs.getVkInstanceData();
+    
+    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+    samplerLayoutBinding.binding = 0;
+    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    samplerLayoutBinding.pImmutableSamplers = nullptr;
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &samplerLayoutBinding;
+
+    VkDescriptorSetLayout dsl;
+    VkResult res = vkCreateDescriptorSetLayout(vkrsinst.device, &layoutInfo, nullptr, &dsl);
+    if (res != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create a descriptor set layout");
+    }
+    
+    _descriptorLayoutMap[DescriptorLayoutType::dltSimpleTextured] = dsl;
+}
+
+void VkRSfactory::createVolumeSliceDescriptorLayout()
+{
+    auto& vkrs = VkRenderSystem::getInstance();
+    VkRSinstance vkrsinst = vkrs.getVkInstanceData();
+    
+    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+    samplerLayoutBinding.binding = 0;
+    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    samplerLayoutBinding.pImmutableSamplers = nullptr;
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutBinding uniformLayoutBinding{};
+    uniformLayoutBinding.binding = 1;
+    uniformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uniformLayoutBinding.descriptorCount = 1;
+    uniformLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutBinding pageTableLayoutBinding{};
+    pageTableLayoutBinding.binding = 2;
+    pageTableLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pageTableLayoutBinding.descriptorCount = 1; //the page table of a bricked volume, or an empty one
+    pageTableLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    
+    std::array<VkDescriptorSetLayoutBinding, 3> layoutBindings = { samplerLayoutBinding, uniformLayoutBinding, pageTableLayoutBinding };
+    
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+    layoutInfo.pBindings = layoutBindings.data();
+
+    VkDescriptorSetLayout dsl;
+    VkResult res = vkCreateDescriptorSetLayout(vkrsinst.device, &layoutInfo, nullptr, &dsl);
+    if (res != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create a descriptor set layout");
+    }
+    
+    _descriptorLayoutMap[DescriptorLayoutType::dltVolumeSlice] = dsl;
+}
+
 VkDescriptorSetLayout VkRSfactory::getDescriptorLayout(const DescriptorLayoutType& dlt)
 {
 
@@ -58,6 +162,30 @@ VkDescriptorSetLayout VkRSfactory::getDescriptorLayout(const DescriptorLayoutTyp
             vkdsl = _descriptorLayoutMap.at(DescriptorLayoutType::dltViewDefault);
             break;
             
+        case DescriptorLayoutType::dltInstanceSlots:
+            if(_descriptorLayoutMap.find(DescriptorLayoutType::dltInstanceSlots) == _descriptorLayoutMap.end())
+            {
+                createInstanceSlotsDescriptorLayout();
+            }
+            vkdsl = _descriptorLayoutMap.at(DescriptorLayoutType::dltInstanceSlots);
+            break;
+            
+        case DescriptorLayoutType::dltSimpleTextured:
+            if(_descriptorLayoutMap.find(DescriptorLayoutType::dltSimpleTextured) == _descriptorLayoutMap.end())
+            {
+                createSimpleTexturedDescriptorLayout();
+            }
+            vkdsl = _descriptorLayoutMap.at(DescriptorLayoutType::dltSimpleTextured);
+            break;
+            
+        case DescriptorLayoutType::dltVolumeSlice:
+            if(_descriptorLayoutMap.find(DescriptorLayoutType::dltVolumeSlice) == _descriptorLayoutMap.end())
+            {
+                createVolumeSliceDescriptorLayout();
+            }
+            vkdsl = _descriptorLayoutMap.at(DescriptorLayoutType::dltVolumeSlice);
+            break;
+            
         case DescriptorLayoutType::dltInvalid:
         default:
             throw std::runtime_error("Invalid descriptor type");
@@ -24,6 +24,9 @@ private:
     static std::unordered_map<RenderPassType, VkRenderPass> _renderPassMap;
     
     static void createViewDefaultDescriptorLayout();
+    static void createInstanceSlotsDescriptorLayout();
+    static void createSimpleTexturedDescriptorLayout();
+    static void createVolumeSliceDescriptorLayout();
     static void createViewSimpleRenderPass();
     
 public:
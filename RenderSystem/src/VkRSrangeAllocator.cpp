@@ -0,0 +1,83 @@
+#include "VkRSrangeAllocator.h"
+#include <assert.h>
+
+void VkRSrangeAllocator::init(VkDeviceSize size)
+{
+    isize = size;
+    ibytesUsed = 0;
+    ifreeRanges.clear();
+    ifreeRanges[0] = size;
+}
+
+bool VkRSrangeAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset)
+{
+    assert(size > 0 && "cannot allocate an empty range");
+    alignment = alignment > 0 ? alignment : 1;
+
+    for (auto iter = ifreeRanges.begin(); iter != ifreeRanges.end(); ++iter)
+    {
+        const VkDeviceSize rangeOffset = iter->first;
+        const VkDeviceSize rangeSize = iter->second;
+        const VkDeviceSize offset = (rangeOffset + alignment - 1) / alignment * alignment;
+        if (offset + size > rangeOffset + rangeSize)
+        {
+            continue;
+        }
+
+        //split off the padding in front and the remainder behind the allocated range
+        ifreeRanges.erase(iter);
+        if (offset > rangeOffset)
+        {
+            ifreeRanges[rangeOffset] = offset - rangeOffset;
+        }
+        if (offset + size < rangeOffset + rangeSize)
+        {
+            ifreeRanges[offset + size] = rangeOffset + rangeSize - offset - size;
+        }
+
+        ibytesUsed += size;
+        outOffset = offset;
+        return true;
+    }
+
+    return false;
+}
+
+void VkRSrangeAllocator::free(VkDeviceSize offset, VkDeviceSize size)
+{
+    assert(offset + size <= isize && "range is out of bounds");
+    ibytesUsed -= size;
+
+    auto next = ifreeRanges.lower_bound(offset);
+    assert((next == ifreeRanges.end() || next->first >= offset + size) && "range is already free");
+
+    //merge with the following free range
+    if (next != ifreeRanges.end() && next->first == offset + size)
+    {
+        size += next->second;
+        next = ifreeRanges.erase(next);
+    }
+
+    //merge with the preceding free range
+    if (next != ifreeRanges.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += size;
+            return;
+        }
+    }
+
+    ifreeRanges[offset] = size;
+}
+
+VkDeviceSize VkRSrangeAllocator::size() const
+{
+    return isize;
+}
+
+VkDeviceSize VkRSrangeAllocator::bytesUsed() const
+{
+    return ibytesUsed;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <iterator>
+
+/**
+ * @brief First fit allocator handing out ranges of a fixed size buffer. Alignments need not be powers of two, so that
+ * interleaved vertex ranges can start at a multiple of their stride. Freed ranges are merged with their neighbours.
+ */
+class VkRSrangeAllocator final
+{
+private:
+    VkDeviceSize isize = 0;
+    VkDeviceSize ibytesUsed = 0;
+    //free ranges, offset to size
+    std::map<VkDeviceSize, VkDeviceSize> ifreeRanges;
+
+public:
+    /**
+     * @brief Resets the allocator to a single free range.
+     * @param size the size of the managed buffer in bytes
+     */
+    void init(VkDeviceSize size);
+
+    /**
+     * @brief Allocates a range.
+     * @param size the size of the range in bytes
+     * @param alignment the range offset is a multiple of alignment
+     * @param outOffset the offset of the range
+     * @return true on success, false if no free range is large enough
+     */
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset);
+
+    /**
+     * @brief Returns a range to the allocator.
+     * @param offset the offset returned by allocate
+     * @param size the size passed to allocate
+     */
+    void free(VkDeviceSize offset, VkDeviceSize size);
+
+    /** @brief Gets the size of the managed buffer. */
+    VkDeviceSize size() const;
+
+    /** @brief Gets the number of bytes currently allocated. */
+    VkDeviceSize bytesUsed() const;
+};
@@ -0,0 +1,82 @@
+#include "VkRSstagingRing.h"
+#include <assert.h>
+
+void VkRSstagingRing::init(VkDeviceSize size)
+{
+    isize = size;
+    ihead = 0;
+    iregions.clear();
+}
+
+bool VkRSstagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset)
+{
+    alignment = alignment > 0 ? alignment : 1;
+    if (size == 0 || size > isize)
+    {
+        return false;
+    }
+
+    if (iregions.empty())
+    {
+        ihead = 0;
+    }
+
+    //free space is behind the head up to the oldest live region, or up to the end and then from the start once wrapped
+    const VkDeviceSize tail = iregions.empty() ? isize : iregions.front().offset;
+    const bool wrapped = !iregions.empty() && iregions.back().offset < tail;
+    const VkDeviceSize alignedHead = (ihead + alignment - 1) / alignment * alignment;
+
+    VkDeviceSize offset = 0;
+    if (wrapped)
+    {
+        if (alignedHead + size > tail)
+        {
+            return false;
+        }
+        offset = alignedHead;
+    }
+    else if (alignedHead + size <= isize)
+    {
+        offset = alignedHead;
+    }
+    else if (!iregions.empty() && size > tail)
+    {
+        return false;
+    }
+    //else wrap to the start, the unused end of the buffer is reclaimed together with the regions in front of it
+
+    Region region;
+    region.offset = offset;
+    region.size = size;
+    iregions.push_back(region);
+    ihead = offset + size;
+    outOffset = offset;
+    return true;
+}
+
+void VkRSstagingRing::release(VkDeviceSize offset, uint64_t serial)
+{
+    for (Region& region : iregions)
+    {
+        if (region.offset == offset && !region.released)
+        {
+            region.serial = serial;
+            region.released = true;
+            return;
+        }
+    }
+    assert(false && "staging range is not allocated from the ring");
+}
+
+void VkRSstagingRing::reclaim(uint64_t completedSerial)
+{
+    while (!iregions.empty() && iregions.front().released && iregions.front().serial <= completedSerial)
+    {
+        iregions.pop_front();
+    }
+}
+
+VkDeviceSize VkRSstagingRing::size() const
+{
+    return isize;
+}
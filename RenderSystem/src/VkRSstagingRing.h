@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+
+/**
+ * @brief Hands out ranges of a persistently mapped staging buffer in ring order. A range is recycled once the upload
+ * batch it was released to has completed. Ranges are reclaimed oldest first, so a range released early waits for
+ * older ones still held by their writer.
+ */
+class VkRSstagingRing final
+{
+private:
+    struct Region
+    {
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        uint64_t serial = 0; //upload batch reading the range
+        bool released = false;
+    };
+
+    VkDeviceSize isize = 0;
+    VkDeviceSize ihead = 0;
+    //live regions, oldest first
+    std::deque<Region> iregions;
+
+public:
+    /**
+     * @brief Resets the ring.
+     * @param size the size of the staging buffer in bytes
+     */
+    void init(VkDeviceSize size);
+
+    /**
+     * @brief Allocates a range behind the most recent one, wrapping around to the start of the buffer if needed.
+     * @param size the size of the range in bytes
+     * @param alignment the range offset is a multiple of alignment
+     * @param outOffset the offset of the range
+     * @return true on success, false if the ring currently has no room for the range
+     */
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset);
+
+    /**
+     * @brief Hands a range over to the upload batch copying out of it.
+     * @param offset the offset returned by allocate
+     * @param serial the serial of the upload batch, 0 if the range was never used
+     */
+    void release(VkDeviceSize offset, uint64_t serial);
+
+    /**
+     * @brief Recycles the oldest released ranges whose upload batch has completed.
+     * @param completedSerial the serial of the latest completed upload batch
+     */
+    void reclaim(uint64_t completedSerial);
+
+    /** @brief Gets the size of the staging buffer. */
+    VkDeviceSize size() const;
+};
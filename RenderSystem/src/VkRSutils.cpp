@@ -1,6 +1,10 @@
 
 #include "VkRSutils.h"
 #include <stdexcept>
+#include <assert.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 VkExtent2D VkRSutils::getDefaultViewExtent()
 {
@@ -39,3 +43,34 @@ VkFormat VkRSutils::findDepthFormat(const VkPhysicalDevice& physicalDevice)
        physicalDevice
     );
 }
+
+void VkRSutils::setBit(std::vector<uint64_t>& bits, uint32_t index, bool value)
+{
+    const uint32_t word = index / 64;
+    if (word >= bits.size())
+    {
+        bits.resize(word + 1, 0);
+    }
+    
+    const uint64_t mask = uint64_t(1) << (index % 64);
+    if (value)
+    {
+        bits[word] |= mask;
+    }
+    else
+    {
+        bits[word] &= ~mask;
+    }
+}
+
+uint32_t VkRSutils::countTrailingZeros(uint64_t word)
+{
+    assert(word != 0 && "word cannot be zero");
+#ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanForward64(&index, word);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(word));
+#endif
+}
@@ -33,5 +33,20 @@ public:
      * @return the valid and optimal format returned by vk.
      */
     static VkFormat findDepthFormat(const VkPhysicalDevice& physicalDevice);
+    
+    /**
+     * @brief Sets or clears a single bit in a dense bitset, growing it if needed.
+     * @param bits the bitset stored as 64 bit words
+     * @param index the bit index
+     * @param value true sets the bit, false clears it
+     */
+    static void setBit(std::vector<uint64_t>& bits, uint32_t index, bool value);
+    
+    /**
+     * @brief Gets the index of the lowest set bit of a non-zero word.
+     * @param word the specified word, must not be zero
+     * @return the number of trailing zero bits
+     */
+    static uint32_t countTrailingZeros(uint64_t word);
 };
 
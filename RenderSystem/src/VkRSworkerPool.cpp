@@ -0,0 +1,104 @@
+#include "VkRSworkerPool.h"
+#include <assert.h>
+
+VkRSworkerPool::~VkRSworkerPool()
+{
+    dispose();
+}
+
+void VkRSworkerPool::init(uint32_t numWorkers)
+{
+    assert(iworkers.empty() && "worker pool is already started");
+
+    istopping = false;
+    iqueues.resize(numWorkers);
+    iworkers.reserve(numWorkers);
+    for (uint32_t i = 0; i < numWorkers; i++)
+    {
+        iworkers.emplace_back(&VkRSworkerPool::workerLoop, this, i);
+    }
+}
+
+void VkRSworkerPool::dispose()
+{
+    {
+        std::lock_guard<std::mutex> lock(imutex);
+        istopping = true;
+    }
+    iworkAvailable.notify_all();
+
+    for (std::thread& worker : iworkers)
+    {
+        worker.join();
+    }
+    iworkers.clear();
+    iqueues.clear();
+}
+
+uint32_t VkRSworkerPool::size() const
+{
+    return static_cast<uint32_t>(iworkers.size());
+}
+
+void VkRSworkerPool::submit(uint32_t workerIndex, std::function<void()> task)
+{
+    assert(workerIndex < iqueues.size() && "invalid worker index");
+    {
+        std::lock_guard<std::mutex> lock(imutex);
+        iqueues[workerIndex].push_back(std::move(task));
+        ipending++;
+    }
+    iworkAvailable.notify_all();
+}
+
+void VkRSworkerPool::wait()
+{
+    std::unique_lock<std::mutex> lock(imutex);
+    iworkDone.wait(lock, [this]() { return ipending == 0; });
+
+    if (ifirstError)
+    {
+        std::exception_ptr error = ifirstError;
+        ifirstError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void VkRSworkerPool::workerLoop(uint32_t workerIndex)
+{
+    std::unique_lock<std::mutex> lock(imutex);
+    while (true)
+    {
+        iworkAvailable.wait(lock, [this, workerIndex]() { return istopping || !iqueues[workerIndex].empty(); });
+        if (iqueues[workerIndex].empty())
+        {
+            //only reached when stopping with nothing left to run
+            return;
+        }
+
+        std::function<void()> task = std::move(iqueues[workerIndex].front());
+        iqueues[workerIndex].pop_front();
+        lock.unlock();
+
+        std::exception_ptr error;
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        if (error && !ifirstError)
+        {
+            ifirstError = error;
+        }
+        ipending--;
+        if (ipending == 0)
+        {
+            iworkDone.notify_all();
+        }
+    }
+}
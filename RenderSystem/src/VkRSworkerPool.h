@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+/**
+ * @brief A fixed set of worker threads, each draining its own task queue. Tasks are pinned to a worker so that
+ * per-worker resources like command pools are only ever touched by one thread.
+ */
+class VkRSworkerPool final
+{
+private:
+    std::vector<std::thread> iworkers;
+    std::vector<std::deque<std::function<void()>>> iqueues;
+    std::mutex imutex;
+    std::condition_variable iworkAvailable;
+    std::condition_variable iworkDone;
+    uint32_t ipending = 0;
+    bool istopping = false;
+    std::exception_ptr ifirstError;
+
+    void workerLoop(uint32_t workerIndex);
+
+public:
+    VkRSworkerPool() = default;
+    VkRSworkerPool(const VkRSworkerPool&) = delete;
+    VkRSworkerPool& operator=(const VkRSworkerPool&) = delete;
+    ~VkRSworkerPool();
+
+    /**
+     * @brief Starts the worker threads.
+     * @param numWorkers the number of threads to start
+     */
+    void init(uint32_t numWorkers);
+
+    /**
+     * @brief Joins all worker threads after draining their queues.
+     */
+    void dispose();
+
+    /**
+     * @brief Gets the number of worker threads.
+     * @return the number of workers, 0 if the pool was not started
+     */
+    uint32_t size() const;
+
+    /**
+     * @brief Queues a task on a specific worker.
+     * @param workerIndex the worker that runs the task
+     * @param task the task to run
+     */
+    void submit(uint32_t workerIndex, std::function<void()> task);
+
+    /**
+     * @brief Blocks until every submitted task has run. Rethrows the first exception thrown by a task.
+     */
+    void wait();
+};
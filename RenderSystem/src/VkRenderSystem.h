@@ -2,8 +2,13 @@
 #include "RStypes.h"
 #include "RSdataTypes.h"
 #include "VkRSdataTypes.h"
+#include "VkRSworkerPool.h"
+#include "VkRSallocator.h"
+#include "VkRSstagingRing.h"
 #include <vector>
 #include <unordered_map>
+#include <deque>
+#include <mutex>
 #include <optional>
 #include <MakeID.h>
 #include "rsids.h"
@@ -29,6 +34,7 @@ private:
     using RSappearances = std::unordered_map<RSappearanceID, VkRSappearance, IDHasher<RSappearanceID>>;
     using RSspatials = std::unordered_map<RSspatialID, VkRSspatial, IDHasher<RSspatialID>>;
     using RSstates = std::unordered_map<RSstateID, VkRSstate, IDHasher<RSstateID>>;
+    using VkRSpipelineRegistry = std::unordered_map<VkRSpipelineKey, VkRSpipeline, VkRSpipelineKeyHasher>;
     
     bool iisRSinited = false;
     MakeID iviewIDpool = MakeID(MAX_IDS);
@@ -53,7 +59,43 @@ private:
     RSstates istateMap;
     
     std::unordered_map<RSshaderTemplate, VkRSshader> ishaderModuleMap;
+    //pipelines shared by every draw with equal pipeline state
+    VkRSpipelineRegistry ipipelineRegistry;
+    VkRSworkerPool ipipelineWorkers;
+    uint32_t inextPipelineWorker = 0;
+    //pipelines compiled by the pipeline workers and not yet applied to the registry
+    std::mutex icompiledMutex;
+    std::vector<VkRSpipelineCompile> icompiledPipelines;
+    VkPipelineCache ipipelineCache = VK_NULL_HANDLE;
+    bool icreationFeedback = false; //the device reports whether pipelines were found in the cache
+    RSpipelineStats ipipelineStats;
     RSspatialID _identitySpatialID;
+    VkRSspatialStore ispatialStore;
+    VkRSallocator iallocator;
+    VkRSworkerPool irecordingWorkers;
+    std::vector<VkCommandPool> irecordingCommandPools; //one per recording worker
+    uint32_t inextRecordingWorker = 0;
+    //fence of the latest submission per frame slot, guards the per frame resources shared by all contexts
+    std::vector<VkFence> iframeFences = std::vector<VkFence>(VkRScontext::MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+    uint64_t isubmitSerial = 0;
+    std::unordered_map<VkFence, uint64_t> ipendingFences; //serial of the unfinished submission of each fence
+    std::deque<VkRSretiredObject> iretireQueue;
+    //upload batch being recorded, followed by the submitted batches in submission order
+    VkRSuploadBatch iuploadBatch;
+    std::deque<VkRSuploadBatch> ipendingUploads;
+    uint64_t iuploadSerial = 0;
+    uint64_t icompletedUploadSerial = 0;
+    uint64_t icompletedSubmitSerial = 0; //as of the latest drain of the retire queue
+    VkRSstagingRing istagingRing;
+    std::unordered_set<RSgeometryDataID, IDHasher<RSgeometryDataID>> idirtyGeometryData; //finalized geometry data with pending updates
+    VkBuffer istagingRingBuffer = VK_NULL_HANDLE;
+    VkRSallocation istagingRingMemory;
+    //bound as the page table of volume slices sampling volumes that are not bricked
+    VkBuffer iemptyPageTable = VK_NULL_HANDLE;
+    VkRSallocation iemptyPageTableMemory;
+    //large vertex and index buffers holding the geometry data when RSinitInfo::sharedGeometryBuffers is set
+    std::vector<VkRSsharedGeometryBuffer> isharedVertexBuffers;
+    std::vector<VkRSsharedGeometryBuffer> isharedIndexBuffers;
     void pickPhysicalDevice();
     
     VkRSqueueFamilyIndices findQueueFamilies(const VkPhysicalDevice device, const VkSurfaceKHR& vksurface);
@@ -112,37 +154,95 @@ private:
     void createSurface(VkRScontext& vkrsctx);
     void createSyncObjects(VkRScontext& ctx);
     void createCommandPool();
-     void recordCommandBuffer(const RScollectionID* collections, uint32_t numCollections, const VkRSview& view, const VkRScontext& ctx, uint32_t imageIndex, uint32_t currentFrame);
+    void createRecordingWorkers(uint32_t numWorkers);
+    void waitForFrame(uint32_t frame);
+    void waitForInFlightFrames();
+    void retire(std::function<void()> destroy);
+    void retirePipeline(VkPipeline pipeline, VkPipelineLayout pipelineLayout);
+    void drainRetireQueue(bool all);
+    void disposeRecordingWorkers();
+     void recordCommandBuffer(const RScollectionID* collections, uint32_t numCollections, VkRSview& view, const VkRScontext& ctx, uint32_t imageIndex, uint32_t currentFrame);
+    void recordCollection(VkCommandBuffer commandBuffer, const RScollectionID& collectionID, const VkRSrecordChunk& chunk, const VkRSview& view, uint32_t currentFrame);
+    void allocateCollectionCommands(VkRScollectionCommands& collcmds, uint32_t numChunks);
+    void freeCollectionCommands(VkRScollectionCommands& collcmds);
+    void invalidateCollectionCommands(VkRSview& view, const RScollectionID& collectionID);
+    void disposeCollectionCommands(VkRSview& view, const RScollectionID& collectionID);
     void disposeContext(VkRScontext& ctx);
      void recreateSwapchain(VkRScontext& ctx, VkRSview& view);
     void disposeView(VkRSview& view);
-    VkImageView createImageView(VkImage image, VkImageViewType imageViewType, VkFormat format, VkImageAspectFlags aspectFlags);
-    void createImage(uint32_t width, uint32_t height, uint32_t depth, VkImageType imageType, VkFormat format, VkImageUsageFlags usage, VkImage &image, VkDeviceMemory &imageMemory);
+    VkImageView createImageView(VkImage image, VkImageViewType imageViewType, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels = 1);
+    void createImage(uint32_t width, uint32_t height, uint32_t depth, VkImageType imageType, VkFormat format, VkImageUsageFlags usage, VkImage &image, VkRSallocation &imageMemory, bool sharedWithTransfer = false, uint32_t mipLevels = 1);
      bool createTextureImage(VkRStexture& vkrstex);
+    void createStreamedTextureImage(VkRStexture& vkrstex);
+    void createBrickedTextureImage(VkRStexture& vkrstex, const RSbrickedVolumeInfo& brickInfo);
+    VkDeviceSize stageVolumeRegion(const RStextureInfo& texinfo, const RSvolumeChunk& region, VkImage image, const glm::uvec3& imageOffset);
+    VkDeviceSize stageVolumeBrick(VkRStexture& vkrstex, uint32_t brick);
+    void stagePageTableUpdates(VkRStexture& vkrstex);
+    VkDeviceSize streamBricks(VkRStexture& vkrstex, VkDeviceSize budget);
+    void updateStreamResidency(const RStextureID& texID, VkRStexture& vkrstex);
+    void streamTextures();
     VkFormat getDefaultTextureFormat(const RStextureFormat& texformat);
     VkImageViewType getImageViewType(const RStextureType& textype);
     VkImageType getImageType(const RStextureType& textype);
     uint32_t getTexelSize(const RStextureType& textype, const RStextureFormat& texformat);
     void createTextureImageView(VkRStexture& vkrstex);
     void createTextureSampler(VkRStexture& vkrstex);
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t depth, const RSvolumeChunk& volchunk);
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+    void copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t depth, const RSvolumeChunk& volchunk, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t mipLevel = 0);
+    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels = 1);
     VkRSshader createShaderModule(const RSshaderTemplate shaderTemplate);
     static std::vector<char> readFile(const std::string& filename, unsigned int openmode);
      void createRenderpass(VkRSview& view);
-     void createGraphicsPipeline(VkRScollection& collection, VkRScollectionInstance& collinst, VkRSdrawCommand& drawcmd);
+    VkPipelineLayout createPipelineLayout(const VkRSpipelineKey& key);
+    VkRSpipelineCompile compileGraphicsPipeline(const VkRSpipelineKey& key, VkPipelineLayout pipelineLayout);
+    VkRSpipelineKey getPipelineKey(const VkRScollectionInstance& collinst, const VkRSdrawCommand& drawcmd, bool instanced);
+    void acquireGraphicsPipeline(VkRScollection& collection, VkRScollectionInstance& collinst, VkRSdrawCommand& drawcmd, bool instanced = false);
+    void releaseGraphicsPipeline(VkRSpipeline* pipeline);
+    void applyCompiledPipeline(const VkRSpipelineCompile& compiled);
+    void pollPipelineCompiles();
+    bool pipelinesReady(const VkRScollection& collection) const;
+    void disposePipelineRegistry();
     void contextDrawCollections(VkRScontext& ctx, VkRSview& view, const RScollectionID* collections, uint32_t numCollections);
      void disposeCollection(VkRScollection& collection);
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memProperties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    void buildDrawList(const RScollectionID& collID, VkRScollection& collection);
+    void buildDrawBatches(VkRScollection& collection);
+    void disposeDrawBatches(VkRScollection& collection);
+    void createInstanceBuffers(VkRScollection& collection, uint32_t numInstances);
+    void createSpatialStore(uint32_t capacity);
+    void disposeSpatialStore();
+    void markSpatialDirty(uint32_t slot);
+    void flushSpatials(uint32_t currentFrame);
+    void writeViewSpatialDescriptors(VkRSview& view);
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memProperties, VkBuffer& buffer, VkRSallocation& bufferMemory, VkRSallocationType allocationType = VkRSallocationType::atGeneral);
+    void copyBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+    VkRSgeometryRange allocateGeometryRange(std::vector<VkRSsharedGeometryBuffer>& sharedBuffers, VkDeviceSize size, VkDeviceSize alignment, VkBufferUsageFlags usage);
+    void freeGeometryRange(std::vector<VkRSsharedGeometryBuffer>& sharedBuffers, VkRSgeometryRange& range);
+    void disposeSharedGeometryBuffers();
     std::vector<VkVertexInputBindingDescription> getBindingDescription(const RSvertexAttribsInfo& attribInfo);
     std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(const RSvertexAttribsInfo& attribInfo);
-    VkCommandBuffer beginSingleTimeCommands();
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+    VkCommandBuffer getUploadCommandBuffer();
+    void createPipelineCache(const std::string& path);
+    void disposePipelineCache(const std::string& path);
+    void createStagingRing(VkDeviceSize size);
+    void disposeStagingRing();
+    VkRSstagingRange acquireStaging(VkDeviceSize size);
+    void releaseStagingAfterUpload(VkRSstagingRange& staging);
+    void discardStaging(VkRSstagingRange& staging);
+    RSresult writeGeometryData(const RSgeometryDataID& gdataID, const VkRSgeometryData& gdata, VkRSstagingRange& staging, VkRSdirtyRanges& dirty, VkDeviceSize capacity, uint32_t offset, uint32_t sizeInBytes, const void* data);
+    char* acquireWriteCopy(const RSgeometryDataID& gdataID, VkRSgeometryData& gdata, const VkRSallocation& memory, VkDeviceSize copySize);
+    RSresult writeDynamicGeometryData(const RSgeometryDataID& gdataID, VkRSgeometryData& gdata, const VkRSallocation& memory, VkDeviceSize capacity, uint32_t offset, uint32_t sizeInBytes, const void* data);
+    void publishDynamicGeometryData(VkRSgeometryData& gdata);
+    void waitForSubmission(uint64_t serial);
+    void stageBufferUpdates(VkRSdirtyRanges& dirty, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+    void stageGeometryDataUpdates();
+    void flushUploads();
+    void recordBufferUpdates(VkCommandBuffer commandBuffer);
+    void pollUploads(bool wait);
+    void waitForUpload(uint64_t serial);
+    bool isUploadComplete(uint64_t serial) const;
     void createDescriptorPool(VkRSview& vkrsview);
     void createAppearanceDescriptorPool();
      VkPrimitiveTopology getPrimitiveType(const RSprimitiveType& ptype);
+    RSshaderTemplate getInstancedShaderTemplate(const RSshaderTemplate shaderTemplate);
     VkCompareOp getDepthCompare(const RSdepthFunction depthFunc);
     
 public:
@@ -161,6 +261,12 @@ public:
     
     RS_EXPORT RSresult renderSystemDispose();
     
+    RS_EXPORT RSmemoryStats renderSystemGetMemoryStats() const;
+    
+    RS_EXPORT RSpipelineStats renderSystemGetPipelineStats() const;
+    
+    RS_EXPORT void renderSystemFlushUploads();
+    
     RS_EXPORT bool viewAvailable(const RSviewID& viewID) const;
     
 
@@ -177,11 +283,16 @@ public:
     RS_EXPORT RSresult contextDispose(const RScontextID& ctxID);
     RS_EXPORT void contextResized(const RScontextID& ctxID, const RSviewID& viewID, uint32_t newWidth, uint32_t newHeight);
     RS_EXPORT bool geometryDataAvailable(const RSgeometryDataID& geomDataID);
-    RS_EXPORT RSresult geometryDataCreate(RSgeometryDataID& outgdataID, uint32_t numVertices, uint32_t numIndices, const RSvertexAttribsInfo attributesInfo);
+    RS_EXPORT RSresult geometryDataCreate(RSgeometryDataID& outgdataID, uint32_t numVertices, uint32_t numIndices, const RSvertexAttribsInfo attributesInfo, RSindexType indexType = RSindexType::itUint32);
     RS_EXPORT RSresult geometryDataUpdateInterleavedVertices(const RSgeometryDataID& gdataID, uint32_t offset, uint32_t sizeInBytes, void* data);
     RS_EXPORT RSresult geometryDataUpdateVertices(const RSgeometryDataID& gdataID, uint32_t offset, uint32_t sizeInBytes, RSvertexAttribute attrib, void* data);
     RS_EXPORT RSresult geometryDataUpdateIndices(const RSgeometryDataID& gdataID, uint32_t offset, uint32_t sizeInBytes, void* data);
+    //dynamic and stream data only: pointers to the copy written this frame, valid until the next collections draw publishes it
+    RS_EXPORT void* geometryDataMapInterleavedVertices(const RSgeometryDataID& gdataID);
+    RS_EXPORT void* geometryDataMapVertices(const RSgeometryDataID& gdataID, RSvertexAttribute attrib);
+    RS_EXPORT void* geometryDataMapIndices(const RSgeometryDataID& gdataID);
     RS_EXPORT RSresult geometryDataFinalize(const RSgeometryDataID& gdataID);
+    RS_EXPORT bool geometryDataIsReady(const RSgeometryDataID& gdataID);
     RS_EXPORT RSresult geometryDataDispose(const RSgeometryDataID& gdataID);
     RS_EXPORT bool geometryAvailable(const RSgeometryID& geomID);
     RS_EXPORT RSresult geometryCreate(RSgeometryID& outgeomID, const RSgeometryInfo& geomInfo);
@@ -193,6 +304,7 @@ public:
     RS_EXPORT void collectionInstanceHide(const RScollectionID& collID, const RSinstanceID& instID, bool hide);
     RS_EXPORT RSresult collectionInstanceDispose(const RScollectionID& collID, RSinstanceID& instID);
     RS_EXPORT RSresult collectionFinalize(const RScollectionID& colID);
+    RS_EXPORT bool collectionReady(const RScollectionID& colID);
     RS_EXPORT RSresult collectionDispose(RScollectionID& colID);
     RS_EXPORT bool appearanceAvailable(const RSappearanceID& appID) const;
     RS_EXPORT RSresult appearanceCreate(RSappearanceID& outAppID, const RSappearanceInfo& appInfo);
@@ -205,8 +317,16 @@ public:
     RS_EXPORT RSresult spatialDispose(const RSspatialID& spatialID);
     RS_EXPORT bool textureAvailable(const RStextureID& texID);
     RS_EXPORT RSresult textureCreate(RStextureID& outTexID, const char* absfilepath);
-    RS_EXPORT RSresult texture3dCreate(RStextureID& outTexID, const RStextureInfo& texInfo);
+    //texInfo.texels are copied before returning, except for streamed volumes which keep uploading bricks from them until textureIsReady reports true or the texture is disposed
+    RS_EXPORT RSresult texture3dCreate(RStextureID& outTexID, const RStextureInfo& texInfo, bool streamed = false, RSmipReduction mipReduction = RSmipReduction::mrNone);
+    //bricks are paged into the pool from texInfo.texels on demand, so they must stay valid until the texture is disposed
+    RS_EXPORT RSresult texture3dCreateBricked(RStextureID& outTexID, const RStextureInfo& texInfo, const RSbrickedVolumeInfo& brickInfo);
     RS_EXPORT RSresult textureCreateFromMemory(RStextureID& outTexID, unsigned char* encodedTexData, uint32_t width, uint32_t height);
+    RS_EXPORT bool textureIsReady(const RStextureID& texID);
+    //streamed and bricked volumes only: the voxel the slices go through, whose bricks are uploaded first
+    RS_EXPORT void textureSetStreamFocus(const RStextureID& texID, const glm::uvec3& focus);
+    //whether every brick covering the region has been uploaded, or the whole upload for volumes that are neither streamed nor bricked
+    RS_EXPORT bool textureIsRegionResident(const RStextureID& texID, const RSvolumeChunk& region);
     RS_EXPORT RSresult textureDispose(const RStextureID& texID);
 
     RS_EXPORT bool stateAvailable(const RSstateID& stateID);
@@ -6,6 +6,9 @@
 #include <set>
 #include <algorithm>
 #include <fstream>
+#include <tuple>
+#include <chrono>
+#include <cstring>
 #include <stdexcept>
 #include "RSVkDebugUtils.h"
 #include <stdio.h>
@@ -34,7 +37,16 @@ RSresult VkRenderSystem::renderSystemInit(const RSinitInfo& info)
 #endif
 
     createLogicalDevice(dummySurface);
+    iallocator.init(iinstance.device, iinstance.physicalDevice);
+    createStagingRing(info.stagingRingSize);
+    createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, iemptyPageTable, iemptyPageTableMemory);
     createCommandPool();
+    createPipelineCache(info.pipelineCachePath);
+    createRecordingWorkers(info.numRecordingThreads);
+    if (info.numPipelineThreads > 0)
+    {
+        ipipelineWorkers.init(info.numPipelineThreads);
+    }
     disposeDummySurface(dummySurface);
     
     createAppearanceDescriptorPool();
@@ -45,7 +57,12 @@ RSresult VkRenderSystem::renderSystemInit(const RSinitInfo& info)
     ishaderModuleMap[RSshaderTemplate::stSimpleTextured] = createShaderModule(RSshaderTemplate::stSimpleTextured);
     ishaderModuleMap[RSshaderTemplate::stVolumeSlice] = createShaderModule(RSshaderTemplate::stVolumeSlice);
     ishaderModuleMap[RSshaderTemplate::stLines] = createShaderModule(RSshaderTemplate::stLines);
+    ishaderModuleMap[RSshaderTemplate::stPassthroughInstanced] = createShaderModule(RSshaderTemplate::stPassthroughInstanced);
+    ishaderModuleMap[RSshaderTemplate::stSimpleLitInstanced] = createShaderModule(RSshaderTemplate::stSimpleLitInstanced);
 
+    //the identity spatial is created before any view, so the store must exist first
+    static const uint32_t INITIAL_SPATIAL_CAPACITY = 1024;
+    createSpatialStore(INITIAL_SPATIAL_CAPACITY);
     RSspatial identitySpl;
     spatialCreate(_identitySpatialID, identitySpl);
     
@@ -66,6 +83,7 @@ void VkRenderSystem::createAppearanceDescriptorPool()
     const uint32_t MAX_FRAMES_IN_FLIGHT = static_cast<uint32_t>(VkRScontext::MAX_FRAMES_IN_FLIGHT);
     const uint32_t maxUniformDescriptors = MAX_APPEARANCES * MAX_FRAMES_IN_FLIGHT;
     const uint32_t maxSamplerDescriptors = MAX_APPEARANCES * MAX_FRAMES_IN_FLIGHT; //one texture + one LUT
+    const uint32_t maxStorageDescriptors = MAX_APPEARANCES * MAX_FRAMES_IN_FLIGHT; //page tables of volume slices
     const uint32_t maxDescriptorSets = 10 * MAX_FRAMES_IN_FLIGHT;
 
     VkDescriptorPoolSize uniformPoolSize{};
@@ -75,8 +93,12 @@ void VkRenderSystem::createAppearanceDescriptorPool()
     VkDescriptorPoolSize samplerPoolSize{};
     samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerPoolSize.descriptorCount = maxSamplerDescriptors;
+
+    VkDescriptorPoolSize storagePoolSize{};
+    storagePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    storagePoolSize.descriptorCount = maxStorageDescriptors;
         
-    std::array<VkDescriptorPoolSize, 2> poolSizes = { uniformPoolSize, samplerPoolSize };
+    std::array<VkDescriptorPoolSize, 3> poolSizes = { uniformPoolSize, samplerPoolSize, storagePoolSize };
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -103,7 +125,11 @@ void VkRenderSystem::createDescriptorPool(VkRSview& vkrsview)
     uniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     uniformPoolSize.descriptorCount = maxUniformDescriptors;
 
-    std::array<VkDescriptorPoolSize, 1> poolSizes = { uniformPoolSize};
+    VkDescriptorPoolSize storagePoolSize{};
+    storagePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    storagePoolSize.descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes = { uniformPoolSize, storagePoolSize };
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -124,12 +150,50 @@ bool VkRenderSystem::isRenderSystemInited()
     return iisRSinited;
 }
 
+RSmemoryStats VkRenderSystem::renderSystemGetMemoryStats() const
+{
+    return iallocator.getStats();
+}
+
+RSpipelineStats VkRenderSystem::renderSystemGetPipelineStats() const
+{
+    return ipipelineStats;
+}
+
+void VkRenderSystem::renderSystemFlushUploads()
+{
+    stageGeometryDataUpdates();
+    flushUploads();
+    pollUploads(false);
+}
+
 RSresult VkRenderSystem::renderSystemDispose() 
 {
+    //finish the compiles in flight so that their pipelines are registered and destroyed below
+    ipipelineWorkers.dispose();
+    pollPipelineCompiles();
+    flushUploads();
+    pollUploads(true);
+    vkDeviceWaitIdle(iinstance.device);
+    drainRetireQueue(true);
+    disposePipelineRegistry();
+    disposePipelineCache(iinitInfo.pipelineCachePath);
+    disposeStagingRing();
+    vkDestroyBuffer(iinstance.device, iemptyPageTable, nullptr);
+    iallocator.free(iemptyPageTableMemory);
+    disposeSpatialStore();
     VkRSfactory::disposeAllDescriptorLayouts();
     VkRSfactory::disposeAllRenderPasses();
 
+    disposeSharedGeometryBuffers();
+
+    disposeRecordingWorkers();
+    if (iinstance.queueFamilyIndices.hasDedicatedTransfer())
+    {
+        vkDestroyCommandPool(iinstance.device, iinstance.transferCommandPool, nullptr);
+    }
     vkDestroyCommandPool(iinstance.device, iinstance.commandPool, nullptr);
+    iallocator.dispose();
     vkDestroyDevice(iinstance.device, nullptr);
     if (iinitInfo.enableValidation) 
     {
@@ -424,6 +488,10 @@ void VkRenderSystem::createLogicalDevice(const VkSurfaceKHR& vksurface)
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     iinstance.queueFamilyIndices = findQueueFamilies(iinstance.physicalDevice, vksurface);
     std::set<uint32_t> uniqueQueueFamiles = { iinstance.queueFamilyIndices.graphicsFamily.value(), iinstance.queueFamilyIndices.presentFamily.value() };
+    if (iinstance.queueFamilyIndices.hasDedicatedTransfer())
+    {
+        uniqueQueueFamiles.insert(iinstance.queueFamilyIndices.transferFamily.value());
+    }
 
     float queuePriority = 1.f;
     for (uint32_t queueFamily : uniqueQueueFamiles) 
@@ -497,6 +565,13 @@ void VkRenderSystem::createLogicalDevice(const VkSurfaceKHR& vksurface)
 
     //get the present queue handle from the logical device
     vkGetDeviceQueue(iinstance.device, iinstance.queueFamilyIndices.presentFamily.value(), 0, &iinstance.presentQueue);
+
+    //uploads go to the dedicated transfer queue when there is one so that they overlap with rendering
+    iinstance.transferQueue = iinstance.graphicsQueue;
+    if (iinstance.queueFamilyIndices.hasDedicatedTransfer())
+    {
+        vkGetDeviceQueue(iinstance.device, iinstance.queueFamilyIndices.transferFamily.value(), 0, &iinstance.transferQueue);
+    }
 }
 
 VkRSqueueFamilyIndices VkRenderSystem::findQueueFamilies(const VkPhysicalDevice device, const VkSurfaceKHR& surface) 
@@ -524,6 +599,20 @@ VkRSqueueFamilyIndices VkRenderSystem::findQueueFamilies(const VkPhysicalDevice
         }
     }
 
+    //transfer only families are backed by copy engines. Their image copies must not be restricted by a transfer granularity,
+    //since volume chunks start at arbitrary slices.
+    for (uint32_t i = 0; i < static_cast<uint32_t>(queueFamilyProperties.size()); ++i) {
+        const VkQueueFamilyProperties& queueFamilyProp = queueFamilyProperties[i];
+        const VkExtent3D& granularity = queueFamilyProp.minImageTransferGranularity;
+        const bool isTransferOnly = (queueFamilyProp.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamilyProp.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+        if (isTransferOnly && granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+            indices.transferFamily = i;
+            if (!(queueFamilyProp.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+                break;
+            }
+        }
+    }
+
     return indices;
 }
 
@@ -569,6 +658,36 @@ void VkRenderSystem::viewCreateDescriptorSets(VkRSview& view)
 
         vkUpdateDescriptorSets(iinstance.device, 1, &descriptorWrite, 0, nullptr);
     }
+    
+    writeViewSpatialDescriptors(view);
+}
+
+void VkRenderSystem::writeViewSpatialDescriptors(VkRSview& view)
+{
+    for (size_t i = 0; i < view.descriptorSets.size(); i++) 
+    {
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = ispatialStore.buffers[i].buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = ispatialStore.buffers[i].size;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = view.descriptorSets[i];
+        descriptorWrite.dstBinding = 1;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(iinstance.device, 1, &descriptorWrite, 0, nullptr);
+    }
+    
+    //updating a bound descriptor set invalidates the command buffers that recorded it
+    for (const auto& iter : view.collectionCommands)
+    {
+        invalidateCollectionCommands(view, iter.first);
+    }
 }
 
 void VkRenderSystem::createUniformBuffers(VkRSview& view) 
@@ -583,7 +702,7 @@ void VkRenderSystem::createUniformBuffers(VkRSview& view)
     for (size_t i = 0; i < VkRScontext::MAX_FRAMES_IN_FLIGHT; i++) 
     {
         createBuffer(buffersize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, view.uniformBuffers[i], view.uniformBuffersMemory[i]);
-        vkMapMemory(iinstance.device, view.uniformBuffersMemory[i], 0, buffersize, 0, &view.uniformBuffersMapped[i]);
+        view.uniformBuffersMapped[i] = view.uniformBuffersMemory[i].mapped;
     }
 }
 
@@ -644,18 +763,25 @@ void VkRenderSystem::viewHideInstance(const RSviewID& viewID, const RScollection
         
         if(hide)
         {
-            vkrsview.hiddenInstances[collectionID].push_back(instanceID);
+            vkrsview.hiddenInstances[collectionID].insert(instanceID);
         }
         else
         {
             if(vkrsview.hiddenInstances.find(collectionID) != vkrsview.hiddenInstances.end())
             {
-                std::vector<RSinstanceID>& hiddenInstanceList = vkrsview.hiddenInstances[collectionID];
-                const auto& iter = std::find(hiddenInstanceList.begin(), hiddenInstanceList.end(), instanceID);
-                if(iter != hiddenInstanceList.end())
-                {
-                    hiddenInstanceList.erase(iter);
-                }
+                vkrsview.hiddenInstances[collectionID].erase(instanceID);
+            }
+        }
+        
+        //instances that are not finalized yet get their bit when the draw list is built
+        if(icollectionMap.find(collectionID) != icollectionMap.end())
+        {
+            const VkRScollection& coll = icollectionMap[collectionID];
+            const auto& slotIter = coll.drawSlots.find(instanceID);
+            if(slotIter != coll.drawSlots.end())
+            {
+                VkRSutils::setBit(vkrsview.hiddenBits[collectionID], slotIter->second, hide);
+                invalidateCollectionCommands(vkrsview, collectionID);
             }
         }
     }
@@ -696,7 +822,7 @@ void VkRenderSystem::createDepthResources(VkRSview& view)
     view.depthImageView = createImageView(view.depthImage, VkImageViewType::VK_IMAGE_VIEW_TYPE_2D, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 }
 
-void VkRenderSystem::createImage(uint32_t width, uint32_t height, uint32_t depth, VkImageType imageType, VkFormat format, VkImageUsageFlags usage, VkImage &image, VkDeviceMemory &imageMemory) 
+void VkRenderSystem::createImage(uint32_t width, uint32_t height, uint32_t depth, VkImageType imageType, VkFormat format, VkImageUsageFlags usage, VkImage &image, VkRSallocation &imageMemory, bool sharedWithTransfer, uint32_t mipLevels) 
 {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -704,7 +830,7 @@ void VkRenderSystem::createImage(uint32_t width, uint32_t height, uint32_t depth
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = depth;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 1;
     imageInfo.format = format;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -714,6 +840,15 @@ void VkRenderSystem::createImage(uint32_t width, uint32_t height, uint32_t depth
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.flags = 0;
     
+    //written by the transfer queue while the graphics queue samples it, so it cannot change owner between uploads
+    const uint32_t queueFamilies[] = { iinstance.queueFamilyIndices.graphicsFamily.value(), iinstance.queueFamilyIndices.transferFamily.value_or(0) };
+    if (sharedWithTransfer && iinstance.queueFamilyIndices.hasDedicatedTransfer())
+    {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = 2;
+        imageInfo.pQueueFamilyIndices = queueFamilies;
+    }
+    
     VkResult res = vkCreateImage(iinstance.device, &imageInfo, nullptr, &image);
     if (res != VK_SUCCESS)
     {
@@ -723,14 +858,9 @@ void VkRenderSystem::createImage(uint32_t width, uint32_t height, uint32_t depth
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(iinstance.device, image, &memRequirements);
     
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    imageMemory = iallocator.allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VkRSallocationType::atGeneral, true);
     
-    res = vkAllocateMemory(iinstance.device, &allocInfo, nullptr, &imageMemory);
-    
-    vkBindImageMemory(iinstance.device, image, imageMemory, 0);
+    vkBindImageMemory(iinstance.device, image, imageMemory.memory, imageMemory.offset);
 }
 
 
@@ -743,19 +873,11 @@ bool VkRenderSystem::createTextureImage(VkRStexture& vkrstex)
         return false;
     }
 
-    VkBuffer stagingBuffer{};
-    VkDeviceMemory stagingBufferMemory{};
-
     VkImageType imageType = getImageType(vkrstex.texinfo.textureType);
     VkFormat imageFormat = getDefaultTextureFormat(vkrstex.texinfo.texelFormat);
     uint32_t texelSz = getTexelSize(vkrstex.texinfo.textureType, vkrstex.texinfo.texelFormat);
 
-    VkDeviceSize imageSize = texinfo.width * texinfo.height * texinfo.depth * texinfo.numChannels * texelSz;
-    VkDeviceSize stagingImageSize = imageSize > iinstance.maxMemoryAllocationSize ? iinstance.maxMemoryAllocationSize : imageSize;
-    
-    createBuffer(stagingImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-    
-    createImage(texinfo.width, texinfo.height, texinfo.depth, imageType, imageFormat, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, vkrstex.textureImage, vkrstex.textureImageMemory);
+    createImage(texinfo.width, texinfo.height, texinfo.depth, imageType, imageFormat, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, vkrstex.textureImage, vkrstex.textureImageMemory, false, texinfo.mipLevels);
     
     switch (vkrstex.texinfo.textureType)
     {
@@ -771,66 +893,348 @@ bool VkRenderSystem::createTextureImage(VkRStexture& vkrstex)
         assert(texinfo.depth >= 1 && "invalid depth setting for 2D textures");
         break;
     }
-    //calculate the number of RSvolumeChunks needed
-    std::vector<RSvolumeChunk> chunkList;
-    float numVoxelsInSlice = static_cast<float>(texinfo.width * texinfo.height);
-    float numVoxelsInChunk = static_cast<float>(iinstance.maxMemoryAllocationSize) / static_cast<float>(texelSz);
-    float numTotalVoxels = static_cast<float>(texinfo.width * texinfo.height * texinfo.depth);
-    float numTotalSlices = static_cast<float>(texinfo.depth);
-    
-    float numSlicesInChunkf = std::ceil(numVoxelsInChunk / numVoxelsInSlice);
-    float numChunksf = std::ceil(numTotalSlices / numSlicesInChunkf);
-
-    std::cout<<"num chunks: "<<numChunksf<<std::endl;
-    float prevZoffset =0;
-    float zcount = 0;
-    for(uint32_t i = 0; i < numChunksf; i++)
-    {
-        RSvolumeChunk chunk;
-        chunk.xoffset = 0;
-        chunk.yoffset = 0;
-        chunk.zoffset = prevZoffset;
-        
-        chunk.xcount = texinfo.width;
-        chunk.ycount = texinfo.height;
-        chunk.zcount =  (i == numChunksf - 1) ? (numTotalSlices - zcount) : numSlicesInChunkf;
-        
-        prevZoffset = prevZoffset + numSlicesInChunkf;
-        zcount = zcount + numSlicesInChunkf;
-        
-        chunkList.push_back(chunk);
+    
+    //chunks are slabs of whole slices of a mip level, small enough that NUM_CHUNKS_IN_FLIGHT of them fit the staging ring at once
+    static const uint32_t NUM_CHUNKS_IN_FLIGHT = 3;
+    static const VkDeviceSize MAX_CHUNK_BYTES = 32ull * 1024 * 1024;
+    VkDeviceSize chunkBytes = istagingRing.size() > 0 ? istagingRing.size() / NUM_CHUNKS_IN_FLIGHT : MAX_CHUNK_BYTES;
+    chunkBytes = chunkBytes < MAX_CHUNK_BYTES ? chunkBytes : MAX_CHUNK_BYTES;
+    chunkBytes = chunkBytes < iinstance.maxMemoryAllocationSize ? chunkBytes : iinstance.maxMemoryAllocationSize;
+    
+    struct LevelChunk
+    {
+        RSvolumeChunk volchunk;
+        uint32_t mipLevel = 0;
+        size_t texelOffset = 0; //into the texels, which hold the levels back to back
+    };
+    std::vector<LevelChunk> chunkList;
+    glm::uvec3 levelSize(texinfo.width, texinfo.height, texinfo.depth);
+    size_t levelOffset = 0;
+    for (uint32_t level = 0; level < texinfo.mipLevels; level++)
+    {
+        const VkDeviceSize sliceBytes = static_cast<VkDeviceSize>(levelSize.x) * levelSize.y * texelSz;
+        const uint32_t numSlicesInChunk = chunkBytes > sliceBytes ? static_cast<uint32_t>(chunkBytes / sliceBytes) : 1;
+        for (uint32_t z = 0; z < levelSize.z; z += numSlicesInChunk)
+        {
+            LevelChunk chunk;
+            chunk.volchunk.xoffset = 0;
+            chunk.volchunk.yoffset = 0;
+            chunk.volchunk.zoffset = static_cast<int32_t>(z);
+            
+            chunk.volchunk.xcount = levelSize.x;
+            chunk.volchunk.ycount = levelSize.y;
+            chunk.volchunk.zcount = levelSize.z - z < numSlicesInChunk ? levelSize.z - z : numSlicesInChunk;
+            chunk.mipLevel = level;
+            chunk.texelOffset = levelOffset + static_cast<size_t>(z * sliceBytes);
+            
+            chunkList.push_back(chunk);
+        }
+        levelOffset += static_cast<size_t>(levelSize.z * sliceBytes);
+        levelSize = glm::max(levelSize / 2u, glm::uvec3(1));
     }
     
 //    //TODO: for debugging purposes
 //    for(size_t i = 0; i < chunkList.size(); i++)
 //    {
-//        RSvolumeChunk volchunk = chunkList[i];
+//        RSvolumeChunk volchunk = chunkList[i].volchunk;
 //        std::cout<<"xoffset: "<<volchunk.xoffset<<", yoffset: "<<volchunk.yoffset<<", zoffset: "<<volchunk.zoffset<<std::endl;
 //        std::cout<<"xcount : "<<volchunk.xcount<<", ycount: "<<volchunk.ycount<<", zcount: "<<volchunk.zcount<<std::endl;
 //    }
     
+    //the image stays in the transfer layout for all chunks and is transitioned once at either end
+    transitionImageLayout(vkrstex.textureImage, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texinfo.mipLevels);
+    std::vector<uint64_t> chunkSerials(chunkList.size(), 0);
     for(size_t i = 0; i < chunkList.size(); i++)
     {
-        const RSvolumeChunk volchunk = chunkList[i];
+        const RSvolumeChunk volchunk = chunkList[i].volchunk;
+        if (i >= NUM_CHUNKS_IN_FLIGHT)
+        {
+            //bounds the staging memory held by the upload, the chunks submitted since keep the GPU busy meanwhile
+            waitForUpload(chunkSerials[i - NUM_CHUNKS_IN_FLIGHT]);
+        }
         
-        void *data;
-        vkMapMemory(iinstance.device, stagingBufferMemory, 0, stagingImageSize, 0, &data);
-        size_t offset = volchunk.xcount * volchunk.ycount * volchunk.zoffset * texelSz;
-        size_t copysize = volchunk.xcount * volchunk.ycount * volchunk.zcount * texelSz;
-        memcpy(data, static_cast<unsigned char*>(texinfo.texels)+offset, static_cast<size_t>(copysize));
-        vkUnmapMemory(iinstance.device, stagingBufferMemory);
-
-        transitionImageLayout(vkrstex.textureImage, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-        copyBufferToImage(stagingBuffer, vkrstex.textureImage, texinfo.width, texinfo.height, texinfo.depth, volchunk);
-        transitionImageLayout(vkrstex.textureImage, imageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        const size_t copysize = static_cast<size_t>(volchunk.xcount) * volchunk.ycount * volchunk.zcount * texelSz;
+        VkRSstagingRange staging = acquireStaging(copysize);
+        memcpy(staging.mapped, static_cast<unsigned char*>(texinfo.texels) + chunkList[i].texelOffset, copysize);
+        copyBufferToImage(staging.buffer, staging.offset, vkrstex.textureImage, texinfo.width, texinfo.height, texinfo.depth, volchunk, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, chunkList[i].mipLevel);
+        chunkSerials[i] = iuploadBatch.serial;
+        
+        const bool lastChunk = i + 1 == chunkList.size();
+        if (lastChunk)
+        {
+            transitionImageLayout(vkrstex.textureImage, imageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texinfo.mipLevels);
+        }
+        releaseStagingAfterUpload(staging);
+        if (!lastChunk)
+        {
+            //submitted right away so that the GPU copies this chunk while the next one is staged
+            flushUploads();
+        }
     }
 
-    vkDestroyBuffer(iinstance.device, stagingBuffer, nullptr);
-    vkFreeMemory(iinstance.device, stagingBufferMemory, nullptr);
+    vkrstex.uploadSerial = iuploadSerial;
 
     return true;
 }
 
+void VkRenderSystem::createStreamedTextureImage(VkRStexture& vkrstex)
+{
+    const RStextureInfo& texinfo = vkrstex.texinfo;
+    assert(texinfo.texels != nullptr && "streamed volumes upload from their texels");
+    
+    //frames sample the image while bricks are still written into it, so it stays in the general layout
+    const VkFormat imageFormat = getDefaultTextureFormat(texinfo.texelFormat);
+    createImage(texinfo.width, texinfo.height, texinfo.depth, getImageType(texinfo.textureType), imageFormat, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, vkrstex.textureImage, vkrstex.textureImageMemory, true);
+    transitionImageLayout(vkrstex.textureImage, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    vkrstex.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    vkrstex.uploadSerial = iuploadSerial;
+    vkrstex.streamed = true;
+    
+    //8 x 8 x 16 bricks use up the residency bits
+    static const glm::uvec3 MAX_GRID_SIZE = glm::uvec3(8, 8, 16);
+    VkRSvolumeStream& stream = vkrstex.stream;
+    const glm::uvec3 dimensions(texinfo.width, texinfo.height, texinfo.depth);
+    stream.brickSize = (dimensions + MAX_GRID_SIZE - 1u) / MAX_GRID_SIZE;
+    stream.gridSize = (dimensions + stream.brickSize - 1u) / stream.brickSize;
+    stream.focus = dimensions / 2u;
+    
+    const uint32_t numBricks = stream.gridSize.x * stream.gridSize.y * stream.gridSize.z;
+    stream.pending.resize(numBricks);
+    for (uint32_t brick = 0; brick < numBricks; brick++)
+    {
+        stream.pending[brick] = brick;
+    }
+    stream.sortPending(dimensions);
+}
+
+VkDeviceSize VkRenderSystem::stageVolumeRegion(const RStextureInfo& texinfo, const RSvolumeChunk& region, VkImage image, const glm::uvec3& imageOffset)
+{
+    const uint32_t texelSz = getTexelSize(texinfo.textureType, texinfo.texelFormat);
+    const size_t rowBytes = static_cast<size_t>(region.xcount) * texelSz;
+    const VkDeviceSize regionBytes = rowBytes * region.ycount * region.zcount;
+    
+    //rows of the region are gathered tightly packed, as copyBufferToImage expects them
+    VkRSstagingRange staging = acquireStaging(regionBytes);
+    unsigned char* dst = static_cast<unsigned char*>(staging.mapped);
+    const unsigned char* texels = static_cast<const unsigned char*>(texinfo.texels);
+    for (uint32_t z = 0; z < region.zcount; z++)
+    {
+        for (uint32_t y = 0; y < region.ycount; y++)
+        {
+            const size_t row = (static_cast<size_t>(region.zoffset + z) * texinfo.height + region.yoffset + y) * texinfo.width + region.xoffset;
+            memcpy(dst, texels + row * texelSz, rowBytes);
+            dst += rowBytes;
+        }
+    }
+    
+    RSvolumeChunk imageRegion = region;
+    imageRegion.xoffset = static_cast<int32_t>(imageOffset.x);
+    imageRegion.yoffset = static_cast<int32_t>(imageOffset.y);
+    imageRegion.zoffset = static_cast<int32_t>(imageOffset.z);
+    copyBufferToImage(staging.buffer, staging.offset, image, texinfo.width, texinfo.height, texinfo.depth, imageRegion, VK_IMAGE_LAYOUT_GENERAL);
+    releaseStagingAfterUpload(staging);
+    return regionBytes;
+}
+
+VkDeviceSize VkRenderSystem::stageVolumeBrick(VkRStexture& vkrstex, uint32_t brick)
+{
+    const RStextureInfo& texinfo = vkrstex.texinfo;
+    const RSvolumeChunk region = vkrstex.stream.getBrickRegion(brick, glm::uvec3(texinfo.width, texinfo.height, texinfo.depth));
+    const VkDeviceSize brickBytes = stageVolumeRegion(texinfo, region, vkrstex.textureImage, glm::uvec3(region.xoffset, region.yoffset, region.zoffset));
+    vkrstex.stream.inFlight.push_back(std::make_pair(brick, iuploadBatch.serial));
+    vkrstex.uploadSerial = iuploadBatch.serial;
+    return brickBytes;
+}
+
+void VkRenderSystem::createBrickedTextureImage(VkRStexture& vkrstex, const RSbrickedVolumeInfo& brickInfo)
+{
+    const RStextureInfo& texinfo = vkrstex.texinfo;
+    const uint32_t brickSize = brickInfo.brickSize;
+    assert(texinfo.texels != nullptr && "bricked volumes upload from their texels");
+    assert(brickSize >= 8 && brickSize <= 256 && (brickSize & (brickSize - 1)) == 0 && "brick size must be a power of two from 8 to 256");
+    
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(iinstance.physicalDevice, &properties);
+    
+    //the atlas never needs more slots than the volume has bricks
+    const glm::uvec3 dimensions(texinfo.width, texinfo.height, texinfo.depth);
+    const glm::uvec3 gridSize = (dimensions + brickSize - 1u) / brickSize;
+    const uint64_t numBricks = static_cast<uint64_t>(gridSize.x) * gridSize.y * gridSize.z;
+    const VkDeviceSize brickBytes = static_cast<VkDeviceSize>(brickSize) * brickSize * brickSize * getTexelSize(texinfo.textureType, texinfo.texelFormat);
+    const VkDeviceSize poolBytes = brickInfo.poolBytes < iinstance.maxMemoryAllocationSize ? brickInfo.poolBytes : iinstance.maxMemoryAllocationSize;
+    uint64_t maxSlots = poolBytes / brickBytes;
+    maxSlots = maxSlots < numBricks ? maxSlots : numBricks;
+    maxSlots = maxSlots > 0 ? maxSlots : 1;
+    
+    //grow the atlas one axis at a time so it stays close to a cube
+    const uint32_t maxSlotsPerAxis = properties.limits.maxImageDimension3D / brickSize;
+    glm::uvec3 slotGrid(1);
+    bool grown = true;
+    while (grown)
+    {
+        grown = false;
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            glm::uvec3 next = slotGrid;
+            next[axis]++;
+            if (next[axis] <= maxSlotsPerAxis && static_cast<uint64_t>(next.x) * next.y * next.z <= maxSlots)
+            {
+                slotGrid = next;
+                grown = true;
+            }
+        }
+    }
+    
+    //frames sample the atlas while bricks are written into it, so it stays in the general layout
+    const glm::uvec3 atlasSize = slotGrid * brickSize;
+    const VkFormat imageFormat = getDefaultTextureFormat(texinfo.texelFormat);
+    createImage(atlasSize.x, atlasSize.y, atlasSize.z, getImageType(texinfo.textureType), imageFormat, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, vkrstex.textureImage, vkrstex.textureImageMemory, true);
+    transitionImageLayout(vkrstex.textureImage, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    vkrstex.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    vkrstex.uploadSerial = iuploadSerial;
+    vkrstex.bricked = true;
+    vkrstex.brickCache.init(dimensions, brickSize, slotGrid);
+    vkrstex.stream.focus = dimensions / 2u;
+    
+    //the page table starts out empty, it is written on the graphics queue like every later change to it
+    const VkDeviceSize pageTableBytes = numBricks * sizeof(uint32_t);
+    createBuffer(pageTableBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vkrstex.pageTableBuffer, vkrstex.pageTableMemory);
+    VkRSstagingRange staging = acquireStaging(pageTableBytes);
+    memset(staging.mapped, 0, static_cast<size_t>(pageTableBytes));
+    getUploadCommandBuffer();
+    VkRSbufferUpdate update;
+    update.srcBuffer = staging.buffer;
+    update.dstBuffer = vkrstex.pageTableBuffer;
+    update.region.srcOffset = staging.offset;
+    update.region.dstOffset = 0;
+    update.region.size = pageTableBytes;
+    iuploadBatch.updates.push_back(update);
+    releaseStagingAfterUpload(staging);
+}
+
+void VkRenderSystem::stagePageTableUpdates(VkRStexture& vkrstex)
+{
+    std::vector<uint32_t> dirtyBricks;
+    vkrstex.brickCache.takeDirtyBricks(dirtyBricks);
+    const std::vector<uint32_t>& pageTable = vkrstex.brickCache.getPageTable();
+    
+    //runs of consecutive entries are copied together
+    size_t first = 0;
+    while (first < dirtyBricks.size())
+    {
+        size_t last = first;
+        while (last + 1 < dirtyBricks.size() && dirtyBricks[last + 1] == dirtyBricks[last] + 1)
+        {
+            last++;
+        }
+        
+        const VkDeviceSize size = (last - first + 1) * sizeof(uint32_t);
+        VkRSstagingRange staging = acquireStaging(size);
+        memcpy(staging.mapped, &pageTable[dirtyBricks[first]], static_cast<size_t>(size));
+        
+        //acquiring staging memory may have flushed the batch, so the batch is picked afterwards
+        getUploadCommandBuffer();
+        VkRSbufferUpdate update;
+        update.srcBuffer = staging.buffer;
+        update.dstBuffer = vkrstex.pageTableBuffer;
+        update.region.srcOffset = staging.offset;
+        update.region.dstOffset = dirtyBricks[first] * sizeof(uint32_t);
+        update.region.size = size;
+        iuploadBatch.updates.push_back(update);
+        releaseStagingAfterUpload(staging);
+        first = last + 1;
+    }
+}
+
+VkDeviceSize VkRenderSystem::streamBricks(VkRStexture& vkrstex, VkDeviceSize budget)
+{
+    VkRSbrickCache& cache = vkrstex.brickCache;
+    const RStextureInfo& texinfo = vkrstex.texinfo;
+    const uint32_t brickSize = cache.getBrickSize();
+    const VkDeviceSize brickBytes = static_cast<VkDeviceSize>(brickSize) * brickSize * brickSize * getTexelSize(texinfo.textureType, texinfo.texelFormat);
+    
+    //bricks are requested every frame, even without budget left, so that the ones in use are not evicted
+    std::vector<uint32_t> sliceBricks;
+    cache.getSliceBricks(vkrstex.stream.focus, sliceBricks);
+    std::vector<VkRSbrickCache::Load> loads;
+    const uint32_t maxLoads = static_cast<uint32_t>((budget + brickBytes - 1) / brickBytes);
+    cache.request(sliceBricks, isubmitSerial + 1, icompletedSubmitSerial, maxLoads, loads);
+    
+    VkDeviceSize streamedBytes = 0;
+    for (const VkRSbrickCache::Load& load : loads)
+    {
+        streamedBytes += stageVolumeRegion(texinfo, cache.getBrickRegion(load.brick), vkrstex.textureImage, cache.getSlotOffset(load.slot));
+        vkrstex.uploadSerial = iuploadBatch.serial;
+    }
+    
+    //page table updates are recorded behind the copies of their batch, so an entry never points at a slot being written
+    stagePageTableUpdates(vkrstex);
+    return streamedBytes;
+}
+
+void VkRenderSystem::updateStreamResidency(const RStextureID& texID, VkRStexture& vkrstex)
+{
+    //bricks become resident once the batch copying them completes
+    VkRSvolumeStream& stream = vkrstex.stream;
+    size_t numInFlight = 0;
+    for (size_t i = 0; i < stream.inFlight.size(); i++)
+    {
+        const uint32_t brick = stream.inFlight[i].first;
+        if (isUploadComplete(stream.inFlight[i].second))
+        {
+            stream.residency[brick / 32] |= 1u << (brick % 32);
+        }
+        else
+        {
+            stream.inFlight[numInFlight++] = stream.inFlight[i];
+        }
+    }
+    if (numInFlight == stream.inFlight.size())
+    {
+        return;
+    }
+    stream.inFlight.resize(numInFlight);
+    
+    for (auto& iter : iappearanceMap)
+    {
+        VkRSappearance& vkrsapp = iter.second;
+        if (vkrsapp.appInfo.shaderTemplate == RSshaderTemplate::stVolumeSlice && vkrsapp.appInfo.diffuseTexture == texID)
+        {
+            updateVolumeSliceUniformBuffers(vkrsapp);
+        }
+    }
+}
+
+void VkRenderSystem::streamTextures()
+{
+    //bytes of bricks staged per frame across all streamed volumes, keeps frame times flat while they stream in
+    static const VkDeviceSize MAX_STREAM_BYTES_PER_FRAME = 16ull * 1024 * 1024;
+    
+    VkDeviceSize streamedBytes = 0;
+    for (auto& iter : itextureMap)
+    {
+        VkRStexture& vkrstex = iter.second;
+        VkRSvolumeStream& stream = vkrstex.stream;
+        if (vkrstex.bricked)
+        {
+            streamedBytes += streamBricks(vkrstex, streamedBytes < MAX_STREAM_BYTES_PER_FRAME ? MAX_STREAM_BYTES_PER_FRAME - streamedBytes : 0);
+            continue;
+        }
+        if (!vkrstex.streamed || (stream.pending.empty() && stream.inFlight.empty()))
+        {
+            continue;
+        }
+        
+        updateStreamResidency(iter.first, vkrstex);
+        while (!stream.pending.empty() && streamedBytes < MAX_STREAM_BYTES_PER_FRAME)
+        {
+            const uint32_t brick = stream.pending.back();
+            stream.pending.pop_back();
+            streamedBytes += stageVolumeBrick(vkrstex, brick);
+        }
+    }
+}
+
 uint32_t VkRenderSystem::getTexelSize(const RStextureType& textype, const RStextureFormat& texformat)
 {
     uint32_t texelSize = 0;
@@ -926,7 +1330,7 @@ void VkRenderSystem::createTextureImageView(VkRStexture& vkrstex)
     VkImageViewType imageViewType = getImageViewType(vkrstex.texinfo.textureType);
     
     //TODO: add more formats in future if needed
-    vkrstex.textureImageView = createImageView(vkrstex.textureImage, imageViewType, format, VK_IMAGE_ASPECT_COLOR_BIT);
+    vkrstex.textureImageView = createImageView(vkrstex.textureImage, imageViewType, format, VK_IMAGE_ASPECT_COLOR_BIT, vkrstex.texinfo.mipLevels);
 }
 
 void VkRenderSystem::createTextureSampler(VkRStexture& vkrstex) 
@@ -966,10 +1370,11 @@ void VkRenderSystem::createTextureSampler(VkRStexture& vkrstex)
     samplerInfo.unnormalizedCoordinates = VK_FALSE;
     samplerInfo.compareEnable = VK_FALSE;
     samplerInfo.compareOp = compareOp;
-    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    //integer volumes cannot blend between levels, the slice shader picks one
+    samplerInfo.mipmapMode = vkrstex.texinfo.mipLevels > 1 ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(vkrstex.texinfo.mipLevels - 1);
 
     VkResult res = vkCreateSampler(iinstance.device, &samplerInfo, nullptr, &vkrstex.textureSampler);
     if (res != VK_SUCCESS)
@@ -978,17 +1383,17 @@ void VkRenderSystem::createTextureSampler(VkRStexture& vkrstex)
     }
 }
 
-void VkRenderSystem::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t depth, const RSvolumeChunk& volchunk) 
+void VkRenderSystem::copyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t depth, const RSvolumeChunk& volchunk, VkImageLayout imageLayout, uint32_t mipLevel) 
 {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    VkCommandBuffer commandBuffer = getUploadCommandBuffer();
     {
         VkBufferImageCopy region{};
-        region.bufferOffset = 0;
+        region.bufferOffset = bufferOffset;
         region.bufferRowLength = 0;
         region.bufferImageHeight = 0;
 
         region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.mipLevel = mipLevel;
         region.imageSubresource.baseArrayLayer = 0;
         region.imageSubresource.layerCount = 1;
 
@@ -1005,14 +1410,13 @@ void VkRenderSystem::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t
             volchunk.ycount,
             volchunk.zcount
         };
-        vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        vkCmdCopyBufferToImage(commandBuffer, buffer, image, imageLayout, 1, &region);
     }
-    endSingleTimeCommands(commandBuffer);
 }
 
-void VkRenderSystem::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) 
+void VkRenderSystem::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels) 
 {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    VkCommandBuffer commandBuffer = getUploadCommandBuffer();
     {
         VkImageMemoryBarrier barrier{};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1024,7 +1428,7 @@ void VkRenderSystem::transitionImageLayout(VkImage image, VkFormat format, VkIma
         barrier.image = image;
         barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.levelCount = mipLevels;
         barrier.subresourceRange.baseArrayLayer = 0;
         barrier.subresourceRange.layerCount = 1;
         barrier.srcAccessMask = 0;
@@ -1042,6 +1446,15 @@ void VkRenderSystem::transitionImageLayout(VkImage image, VkFormat format, VkIma
             sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
             destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
         }
+        else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_GENERAL) 
+        {
+            //streamed images, their reads are ordered after the uploads by the barriers closing each upload batch
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        }
         else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) 
         {
 
@@ -1050,6 +1463,15 @@ void VkRenderSystem::transitionImageLayout(VkImage image, VkFormat format, VkIma
 
             sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
             destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+            //the transfer queue cannot reach the fragment shader stage, the layout change happens with the ownership transfer
+            if (iinstance.queueFamilyIndices.hasDedicatedTransfer())
+            {
+                barrier.srcQueueFamilyIndex = iinstance.queueFamilyIndices.transferFamily.value();
+                barrier.dstQueueFamilyIndex = iinstance.queueFamilyIndices.graphicsFamily.value();
+                iuploadBatch.imageAcquires.push_back(barrier);
+                return;
+            }
         }
         else 
         {
@@ -1065,7 +1487,6 @@ void VkRenderSystem::transitionImageLayout(VkImage image, VkFormat format, VkIma
             1, &barrier
         );
     }
-    endSingleTimeCommands(commandBuffer);
 }
 
 VkFormat VkRenderSystem::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) 
@@ -1103,13 +1524,18 @@ bool VkRenderSystem::hasStencilComponent(VkFormat format)
 
 void VkRenderSystem::disposeView(VkRSview& view) 
 {
+    for (auto& iter : view.collectionCommands)
+    {
+        freeCollectionCommands(iter.second);
+    }
+    view.collectionCommands.clear();
 
     vkDestroyDescriptorPool(iinstance.device, view.descriptorPool, nullptr);
 
     for (size_t i = 0; i < VkRScontext::MAX_FRAMES_IN_FLIGHT; i++) 
     {
         vkDestroyBuffer(iinstance.device, view.uniformBuffers[i], nullptr);
-        vkFreeMemory(iinstance.device, view.uniformBuffersMemory[i], nullptr);
+        iallocator.free(view.uniformBuffersMemory[i]);
     }
 
     for (const auto& imageView : view.swapChainImageViews) 
@@ -1130,9 +1556,12 @@ RSresult VkRenderSystem::viewDispose(const RSviewID& viewID)
 {
     if (viewAvailable(viewID)) 
     {
-        VkRSview& vkrsview = iviewMap[viewID];
-        //dispose view contents
-        disposeView(vkrsview);
+        //the swapchain and view resources are destroyed once the frames presenting them retire
+        VkRSview vkrsview = iviewMap[viewID];
+        retire([this, vkrsview]() mutable
+        {
+            disposeView(vkrsview);
+        });
         iviewMap.erase(viewID);
         iviewIDpool.DestroyID(viewID.id);
         return RSresult::SUCCESS;
@@ -1190,9 +1619,9 @@ void VkRenderSystem::createSurface(VkRScontext& vkrsctx)
 
 void VkRenderSystem::createSyncObjects(VkRScontext& ctx) 
 {
-    ctx.imageAvailableSemaphores.resize(VkRScontext::MAX_FRAMES_IN_FLIGHT);
-    ctx.renderFinishedSemaphores.resize(VkRScontext::MAX_FRAMES_IN_FLIGHT);
-    ctx.inFlightFences.resize(VkRScontext::MAX_FRAMES_IN_FLIGHT);
+    ctx.imageAvailableSemaphores.resize(ctx.framesInFlight);
+    ctx.renderFinishedSemaphores.resize(ctx.framesInFlight);
+    ctx.inFlightFences.resize(ctx.framesInFlight);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1202,7 +1631,7 @@ void VkRenderSystem::createSyncObjects(VkRScontext& ctx)
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
     const VkDevice& device = iinstance.device;
-    for (size_t i = 0; i < VkRScontext::MAX_FRAMES_IN_FLIGHT; ++i) 
+    for (size_t i = 0; i < ctx.framesInFlight; ++i) 
     {
         VkResult imgAvailSemaphoreRes = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &ctx.imageAvailableSemaphores[i]);
         VkResult renderFinishedSemaphoreRes = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &ctx.renderFinishedSemaphores[i]);
@@ -1219,10 +1648,25 @@ void VkRenderSystem::createSyncObjects(VkRScontext& ctx)
 void VkRenderSystem::disposeContext(VkRScontext& ctx) 
 {
     const VkDevice& device = iinstance.device;
+    
+    //frames of this context may still be in flight, and their fences must not be waited on once destroyed
+    vkWaitForFences(device, static_cast<uint32_t>(ctx.inFlightFences.size()), ctx.inFlightFences.data(), VK_TRUE, UINT64_MAX);
+    for (VkFence& frameFence : iframeFences)
+    {
+        if (std::find(ctx.inFlightFences.begin(), ctx.inFlightFences.end(), frameFence) != ctx.inFlightFences.end())
+        {
+            frameFence = VK_NULL_HANDLE;
+        }
+    }
+    for (const VkFence fence : ctx.inFlightFences)
+    {
+        ipendingFences.erase(fence);
+    }
+    
     vkDestroySurfaceKHR(iinstance.instance, ctx.surface, nullptr);
     ctx.surface = nullptr;
 
-    for (size_t i = 0; i < VkRScontext::MAX_FRAMES_IN_FLIGHT; ++i) 
+    for (size_t i = 0; i < ctx.framesInFlight; ++i) 
     {
         vkDestroySemaphore(device, ctx.imageAvailableSemaphores[i], nullptr);
         vkDestroySemaphore(device, ctx.renderFinishedSemaphores[i], nullptr);
@@ -1248,6 +1692,15 @@ RSresult VkRenderSystem::contextCreate(RScontextID& outCtxID, const RScontextInf
         vkrsctx.info = info;
         vkrsctx.width = info.initWidth;
         vkrsctx.height = info.initHeight;
+        vkrsctx.framesInFlight = info.framesInFlight;
+        if (vkrsctx.framesInFlight < 1)
+        {
+            vkrsctx.framesInFlight = 1;
+        }
+        else if (vkrsctx.framesInFlight > VkRScontext::MAX_FRAMES_IN_FLIGHT)
+        {
+            vkrsctx.framesInFlight = VkRScontext::MAX_FRAMES_IN_FLIGHT;
+        }
         
         createSurface(vkrsctx);
         createSyncObjects(vkrsctx);
@@ -1296,9 +1749,127 @@ void VkRenderSystem::createCommandPool()
     {
         throw std::runtime_error("faailed to create command pool");
     }
+
+    iinstance.transferCommandPool = iinstance.commandPool;
+    if (iinstance.queueFamilyIndices.hasDedicatedTransfer())
+    {
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = iinstance.queueFamilyIndices.transferFamily.value();
+        if (vkCreateCommandPool(iinstance.device, &poolInfo, nullptr, &iinstance.transferCommandPool) != VK_SUCCESS) 
+        {
+            throw std::runtime_error("failed to create transfer command pool");
+        }
+    }
+}
+
+void VkRenderSystem::createRecordingWorkers(uint32_t numWorkers)
+{
+    //command pools are externally synchronized, so every worker records from its own
+    irecordingCommandPools.resize(numWorkers);
+    for (uint32_t i = 0; i < numWorkers; i++)
+    {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = iinstance.queueFamilyIndices.graphicsFamily.value();
+        const VkResult cmdpoolResult = vkCreateCommandPool(iinstance.device, &poolInfo, nullptr, &irecordingCommandPools[i]);
+        if (cmdpoolResult != VK_SUCCESS) 
+        {
+            throw std::runtime_error("failed to create recording command pool");
+        }
+    }
+    
+    if (numWorkers > 0)
+    {
+        irecordingWorkers.init(numWorkers);
+    }
+}
+
+void VkRenderSystem::waitForFrame(uint32_t frame)
+{
+    const VkFence frameFence = iframeFences[frame];
+    if (frameFence != VK_NULL_HANDLE)
+    {
+        vkWaitForFences(iinstance.device, 1, &frameFence, VK_TRUE, UINT64_MAX);
+    }
+}
+
+void VkRenderSystem::waitForInFlightFrames()
+{
+    std::vector<VkFence> fences;
+    for (const VkFence frameFence : iframeFences)
+    {
+        if (frameFence != VK_NULL_HANDLE)
+        {
+            fences.push_back(frameFence);
+        }
+    }
+    
+    if (!fences.empty())
+    {
+        vkWaitForFences(iinstance.device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX);
+    }
+}
+
+void VkRenderSystem::retire(std::function<void()> destroy)
+{
+    VkRSretiredObject retired;
+    retired.serial = isubmitSerial;
+    retired.destroy = std::move(destroy);
+    iretireQueue.push_back(std::move(retired));
 }
 
-void VkRenderSystem::recordCommandBuffer(const RScollectionID* collections, uint32_t numCollections, const VkRSview& view, const VkRScontext& ctx, uint32_t imageIndex, uint32_t currentFrame)
+void VkRenderSystem::retirePipeline(VkPipeline pipeline, VkPipelineLayout pipelineLayout)
+{
+    const VkDevice device = iinstance.device;
+    retire([device, pipeline, pipelineLayout]()
+    {
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    });
+}
+
+void VkRenderSystem::drainRetireQueue(bool all)
+{
+    //a fence is only reset right before it is submitted again, so earlier submissions of a pending fence are done
+    //and everything older than the oldest pending submission has completed.
+    uint64_t completedSerial = isubmitSerial;
+    for (auto iter = ipendingFences.begin(); iter != ipendingFences.end();)
+    {
+        if (vkGetFenceStatus(iinstance.device, iter->first) == VK_SUCCESS)
+        {
+            iter = ipendingFences.erase(iter);
+            continue;
+        }
+        
+        if (iter->second - 1 < completedSerial)
+        {
+            completedSerial = iter->second - 1;
+        }
+        ++iter;
+    }
+    icompletedSubmitSerial = completedSerial;
+    
+    while (!iretireQueue.empty() && (all || iretireQueue.front().serial <= completedSerial))
+    {
+        //destroying may retire more objects, so the entry is taken off the queue first
+        VkRSretiredObject retired = std::move(iretireQueue.front());
+        iretireQueue.pop_front();
+        retired.destroy();
+    }
+}
+
+void VkRenderSystem::disposeRecordingWorkers()
+{
+    irecordingWorkers.dispose();
+    for (VkCommandPool pool : irecordingCommandPools)
+    {
+        vkDestroyCommandPool(iinstance.device, pool, nullptr);
+    }
+    irecordingCommandPools.clear();
+}
+
+void VkRenderSystem::recordCommandBuffer(const RScollectionID* collections, uint32_t numCollections, VkRSview& view, const VkRScontext& ctx, uint32_t imageIndex, uint32_t currentFrame)
 {
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1326,107 +1897,367 @@ void VkRenderSystem::recordCommandBuffer(const RScollectionID* collections, uint
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE);
+    //collections are recorded once into secondary command buffers and replayed until they change. Stale ones are
+    //re-recorded a chunk at a time, on the recording workers when there are any.
+    const bool useWorkers = irecordingWorkers.size() > 0;
+    
+    //command buffers are allocated up front, a worker's pool must not be used while the worker records from it
+    for (uint32_t i = 0; i < numCollections; i++) 
     {
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(view.swapChainExtent.width);
-        viewport.height = static_cast<float>(view.swapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-        
-        VkRect2D scissor{};
-        scissor.offset = { 0, 0 };
-        scissor.extent = view.swapChainExtent;
-        vkCmdSetScissor(view.commandBuffers[currentFrame], 0, 1, &scissor);
+        const uint32_t numChunks = static_cast<uint32_t>(icollectionMap.at(collections[i]).recordChunks.size());
+        VkRScollectionCommands& collcmds = view.collectionCommands[collections[i]];
+        if (collcmds.chunkPools.size() != numChunks || collcmds.recordedVersions.empty())
+        {
+            freeCollectionCommands(collcmds);
+            allocateCollectionCommands(collcmds, numChunks);
+        }
+    }
+    
+    std::vector<VkCommandBuffer> secondaryBuffers;
+    secondaryBuffers.reserve(numCollections);
+    for (uint32_t i = 0; i < numCollections; i++) 
+    {
+        const RScollectionID collectionID = collections[i];
+        //workers read the collection map while this loop runs, so it must not be modified here
+        VkRScollection& collection = icollectionMap.at(collectionID);
+        const uint32_t numChunks = static_cast<uint32_t>(collection.recordChunks.size());
+        VkRScollectionCommands& collcmds = view.collectionCommands.at(collectionID);
         
-        for (uint32_t i = 0; i < numCollections; i++) 
+        //instance slots are written while recording, so another view drawing the collection makes them stale too
+        const bool ownsInstanceSlots = collection.instanceSlotsWriters.empty() || collection.instanceSlotsWriters[currentFrame] == &view;
+        const bool stale = collcmds.recordedVersions[currentFrame] != collection.version || !ownsInstanceSlots;
+        for (uint32_t c = 0; c < numChunks; c++)
         {
-            const RScollectionID collectionID = collections[i];
-            const VkRScollection& collection = icollectionMap[collectionID];
-            for (const auto& iter : collection.drawCommands)
+            const VkCommandBuffer secondaryBuffer = collcmds.commandBuffers[c * VkRScontext::MAX_FRAMES_IN_FLIGHT + currentFrame];
+            if (stale)
             {
-                if(view.hiddenInstances.find(collectionID) != view.hiddenInstances.end())
+                const VkRSrecordChunk& chunk = collection.recordChunks[c];
+                const auto recordChunk = [this, secondaryBuffer, collectionID, &chunk, &view, currentFrame]()
                 {
-                    const std::vector<RSinstanceID>& instanceList = view.hiddenInstances.at(collectionID);
-                    if(std::find(instanceList.begin(), instanceList.end(), iter.first) != instanceList.end())
-                    {
-                        continue;
-                    }
-                }
+                    vkResetCommandBuffer(secondaryBuffer, 0);
+                    recordCollection(secondaryBuffer, collectionID, chunk, view, currentFrame);
+                };
                 
-                const VkRScollectionInstance& vkrsci = collection.instanceMap.at(iter.first);
-
-                if(vkrsci.hide)
+                if (useWorkers)
                 {
-//                    std::cout<<"Hidden: "<<vkrsci.instInfo.name<<std::endl;
-                    continue;
+                    irecordingWorkers.submit(collcmds.chunkWorkers[c], recordChunk);
                 }
-                
-                const VkRSdrawCommand& drawcmd = iter.second;
-                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawcmd.graphicsPipeline);
-
-                std::vector<VkDeviceSize> offsets;
-                switch (drawcmd.attribSetting) 
+                else
                 {
-                    case RSvertexAttributeSettings::vasInterleaved: 
-                    {
-                        VkBuffer vertexBuffers[]{ drawcmd.vertexBuffers[0]};
-                        offsets = { drawcmd.vertexOffset };
-                        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets.data());
-                        break;
-                    }
-
-                    case RSvertexAttributeSettings::vasSeparate: 
-                    {
-                        offsets = { 0, 0, 0, 0 };
-                        vkCmdBindVertexBuffers(commandBuffer, 0, static_cast<uint32_t>(drawcmd.vertexBuffers.size()), drawcmd.vertexBuffers.data(), offsets.data());
-                        break;
-                    }
+                    recordChunk();
                 }
+            }
+            secondaryBuffers.push_back(secondaryBuffer);
+        }
+        
+        if (stale)
+        {
+            collcmds.recordedVersions[currentFrame] = collection.version;
+            if (!collection.instanceSlotsWriters.empty())
+            {
+                collection.instanceSlotsWriters[currentFrame] = &view;
+            }
+        }
+    }
+    
+    if (useWorkers)
+    {
+        irecordingWorkers.wait();
+    }
 
-                if (drawcmd.isIndexed) 
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VkSubpassContents::VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    if (!secondaryBuffers.empty())
+    {
+        vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaryBuffers.size()), secondaryBuffers.data());
+    }
+    vkCmdEndRenderPass(commandBuffer);
+
+    const VkResult endCmdBuffRes = vkEndCommandBuffer(commandBuffer);
+    if (endCmdBuffRes != VK_SUCCESS) 
+    {
+        throw std::runtime_error("failed to record command buffer");
+    }
+}
+
+void VkRenderSystem::recordCollection(VkCommandBuffer commandBuffer, const RScollectionID& collectionID, const VkRSrecordChunk& chunk, const VkRSview& view, uint32_t currentFrame)
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = view.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = VK_NULL_HANDLE; //recorded buffers are replayed into any swapchain framebuffer
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    const VkResult beginRes = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    if (beginRes != VK_SUCCESS) 
+    {
+        throw std::runtime_error("failed to begin recording command buffers!");
+    }
+    
+    //secondary command buffers do not inherit dynamic state
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(view.swapChainExtent.width);
+    viewport.height = static_cast<float>(view.swapChainExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    
+    VkRect2D scissor{};
+    scissor.offset = { 0, 0 };
+    scissor.extent = view.swapChainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    //track what is currently bound so that consecutive draws sharing state do not rebind it.
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    VkPipelineLayout boundPipelineLayout = VK_NULL_HANDLE;
+    RSappearanceID boundAppID;
+    VkDescriptorSet boundInstanceSet = VK_NULL_HANDLE;
+    std::vector<VkBuffer> boundVertexBuffers;
+    std::vector<VkDeviceSize> boundVertexBufferOffsets;
+    VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+    VkDeviceSize boundIndexOffset = 0;
+    VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;
+    std::vector<VkDeviceSize> dynamicOffsets;
+    const VkDescriptorSet viewDescriptorSet = view.descriptorSets[currentFrame];
+    
+    const auto bindDrawState = [&](const VkRSdrawCommand& drawcmd, VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet instanceSet)
+    {
+        if (pipeline != boundPipeline)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            boundPipeline = pipeline;
+        }
+
+        const std::vector<VkDeviceSize>* vertexBufferOffsets = &drawcmd.vertexBufferOffsets;
+        VkDeviceSize indexOffset = 0;
+        if (drawcmd.dynamicGeometry)
+        {
+            //dynamic geometry data is bound at the copy that is current while recording, publishing one re-records
+            const auto& gdataIter = igeometryDataMap.find(drawcmd.gdataID);
+            const uint32_t copy = gdataIter != igeometryDataMap.end() ? gdataIter->second.currentCopy : 0;
+            dynamicOffsets.resize(drawcmd.vertexBufferOffsets.size());
+            for (size_t i = 0; i < dynamicOffsets.size(); i++)
+            {
+                dynamicOffsets[i] = drawcmd.vertexBufferOffsets[i] + copy * drawcmd.vertexCopyStrides[i];
+            }
+            vertexBufferOffsets = &dynamicOffsets;
+            indexOffset = copy * drawcmd.indicesCopyStride;
+        }
+
+        if (drawcmd.vertexBuffers != boundVertexBuffers || *vertexBufferOffsets != boundVertexBufferOffsets)
+        {
+            vkCmdBindVertexBuffers(commandBuffer, 0, static_cast<uint32_t>(drawcmd.vertexBuffers.size()), drawcmd.vertexBuffers.data(), vertexBufferOffsets->data());
+            boundVertexBuffers = drawcmd.vertexBuffers;
+            boundVertexBufferOffsets = *vertexBufferOffsets;
+        }
+
+        //a shared index buffer holds ranges of both index types, so a change of type alone rebinds it
+        if (drawcmd.isIndexed && (drawcmd.indicesBuffer != boundIndexBuffer || indexOffset != boundIndexOffset || drawcmd.indexType != boundIndexType)) 
+        {
+            vkCmdBindIndexBuffer(commandBuffer, drawcmd.indicesBuffer, indexOffset, drawcmd.indexType);
+            boundIndexBuffer = drawcmd.indicesBuffer;
+            boundIndexOffset = indexOffset;
+            boundIndexType = drawcmd.indexType;
+        }
+        
+        //bind the descriptor sets
+        if (pipelineLayout != boundPipelineLayout || drawcmd.appID != boundAppID || instanceSet != boundInstanceSet)
+        {
+            std::vector<VkDescriptorSet> descriptorSets;
+            descriptorSets.push_back(viewDescriptorSet);
+            if(drawcmd.appID.isValid())
+            {
+                const VkRSappearance& vkrsapp = iappearanceMap.at(drawcmd.appID);
+                if(vkrsapp.descriptorSetLayout != VK_NULL_HANDLE)
                 {
-                    vkCmdBindIndexBuffer(commandBuffer, drawcmd.indicesBuffer, 0, VkIndexType::VK_INDEX_TYPE_UINT32);
+                    descriptorSets.push_back(vkrsapp.descriptorSets[currentFrame]);
                 }
+            }
+            if(instanceSet != VK_NULL_HANDLE)
+            {
+                descriptorSets.push_back(instanceSet);
+            }
+            uint32_t numDescriptorSets = static_cast<uint32_t>(descriptorSets.size());
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, numDescriptorSets, descriptorSets.data(), 0, nullptr);
+            boundPipelineLayout = pipelineLayout;
+            boundAppID = drawcmd.appID;
+            boundInstanceSet = instanceSet;
+        }
+    };
+
+    const VkRScollection& collection = icollectionMap.at(collectionID);
+    const auto& hiddenIter = view.hiddenBits.find(collectionID);
+    const std::vector<uint64_t>* viewHiddenBits = hiddenIter != view.hiddenBits.end() ? &hiddenIter->second : nullptr;
+    
+    for (uint32_t b = chunk.firstBatch; b < chunk.firstBatch + chunk.numBatches; b++)
+    {
+        const VkRSdrawBatch& batch = collection.batches[b];
+        const uint32_t batchEnd = batch.firstSlot + batch.numSlots;
+        uint32_t* instanceSlots = nullptr;
+        if (batch.instanced)
+        {
+            instanceSlots = static_cast<uint32_t*>(collection.instanceBuffers[currentFrame].mapped) + batch.firstInstance;
+        }
+        uint32_t numVisible = 0;
+        
+        //walk the visible slots of the batch a word at a time, fully hidden words are skipped
+        for (uint32_t base = batch.firstSlot - (batch.firstSlot % 64); base < batchEnd; base += 64)
+        {
+            const uint32_t word = base / 64;
+            uint64_t visible = ~uint64_t(0);
+            if (word < collection.hiddenBits.size())
+            {
+                visible &= ~collection.hiddenBits[word];
+            }
+            if (viewHiddenBits != nullptr && word < viewHiddenBits->size())
+            {
+                visible &= ~(*viewHiddenBits)[word];
+            }
+            if (batch.firstSlot > base)
+            {
+                visible &= ~uint64_t(0) << (batch.firstSlot - base);
+            }
+            if (batchEnd - base < 64)
+            {
+                visible &= (uint64_t(1) << (batchEnd - base)) - 1;
+            }
+            
+            while (visible != 0)
+            {
+                const uint32_t slot = base + VkRSutils::countTrailingZeros(visible);
+                visible &= visible - 1;
+                const VkRSdrawCommand& drawcmd = collection.drawList[slot];
                 
-                //bind the descriptor sets
-                std::vector<VkDescriptorSet> descriptorSets;
-                descriptorSets.push_back(view.descriptorSets[currentFrame]);
-                if(drawcmd.appID.isValid())
+                //instanced batches gather the spatial slots of their visible instances and draw once below
+                if (batch.instanced)
                 {
-                    const VkRSappearance& vkrsapp = iappearanceMap[drawcmd.appID];
-                    if(vkrsapp.descriptorSetLayout != VK_NULL_HANDLE)
-                    {
-                        descriptorSets.push_back(vkrsapp.descriptorSets[currentFrame]);
-                    }
+                    instanceSlots[numVisible++] = drawcmd.spatialID.id;
+                    continue;
+                }
+
+                const VkPipeline pipeline = drawcmd.pipeline->getBindable();
+                if (pipeline == VK_NULL_HANDLE)
+                {
+                    //still compiling with nothing compatible to draw with, the collection is re-recorded once it is ready
+                    continue;
                 }
-                uint32_t numDescriptorSets = static_cast<uint32_t>(descriptorSets.size());
-                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawcmd.pipelineLayout, 0, numDescriptorSets, descriptorSets.data(), 0, nullptr);
-                const RSspatial& spatial = ispatialMap[drawcmd.spatialID].spatial;
-                vkCmdPushConstants(commandBuffer, drawcmd.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(RSspatial), &spatial);
+                bindDrawState(drawcmd, pipeline, drawcmd.pipelineLayout, VK_NULL_HANDLE);
+                VkRSdrawConstants drawConstants = drawcmd.drawConstants;
+                drawConstants.spatialSlot = drawcmd.spatialID.id;
+                vkCmdPushConstants(commandBuffer, drawcmd.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkRSdrawConstants), &drawConstants);
 
                 if (drawcmd.isIndexed) 
                 {
-                    vkCmdDrawIndexed(commandBuffer, drawcmd.numIndices, 1, 0, 0, 0);
+                    vkCmdDrawIndexed(commandBuffer, drawcmd.numIndices, 1, drawcmd.indicesOffset, static_cast<int32_t>(drawcmd.vertexOffset), 0);
                 }
                 else 
                 {
-                    vkCmdDraw(commandBuffer, drawcmd.numVertices, 1, 0, 0);
+                    vkCmdDraw(commandBuffer, drawcmd.numVertices, 1, drawcmd.vertexOffset, 0);
                 }
             }
         }
-    }
-    vkCmdEndRenderPass(view.commandBuffers[currentFrame]);
         
+        const VkPipeline batchPipeline = batch.instanced ? batch.pipeline->getBindable() : VK_NULL_HANDLE;
+        if (batch.instanced && numVisible > 0 && batchPipeline != VK_NULL_HANDLE)
+        {
+            const VkRSdrawCommand& drawcmd = collection.drawList[batch.firstSlot];
+            bindDrawState(drawcmd, batchPipeline, batch.pipelineLayout, collection.instanceDescriptorSets[currentFrame]);
+            vkCmdPushConstants(commandBuffer, batch.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkRSdrawConstants), &drawcmd.drawConstants);
+            if (drawcmd.isIndexed) 
+            {
+                vkCmdDrawIndexed(commandBuffer, drawcmd.numIndices, numVisible, drawcmd.indicesOffset, static_cast<int32_t>(drawcmd.vertexOffset), batch.firstInstance);
+            }
+            else 
+            {
+                vkCmdDraw(commandBuffer, drawcmd.numVertices, numVisible, drawcmd.vertexOffset, batch.firstInstance);
+            }
+        }
+    }
 
     const VkResult endCmdBuffRes = vkEndCommandBuffer(commandBuffer);
     if (endCmdBuffRes != VK_SUCCESS) 
     {
-        throw std::runtime_error("failed to record command buffer");
+        throw std::runtime_error("failed to record secondary command buffer");
+    }
+}
+
+void VkRenderSystem::invalidateCollectionCommands(VkRSview& view, const RScollectionID& collectionID)
+{
+    const auto& iter = view.collectionCommands.find(collectionID);
+    if (iter != view.collectionCommands.end())
+    {
+        VkRScollectionCommands& collcmds = iter->second;
+        std::fill(collcmds.recordedVersions.begin(), collcmds.recordedVersions.end(), VkRScollectionCommands::INVALID_VERSION);
+    }
+}
+
+void VkRenderSystem::disposeCollectionCommands(VkRSview& view, const RScollectionID& collectionID)
+{
+    const auto& iter = view.collectionCommands.find(collectionID);
+    if (iter != view.collectionCommands.end())
+    {
+        freeCollectionCommands(iter->second);
+        view.collectionCommands.erase(iter);
+    }
+}
+
+void VkRenderSystem::allocateCollectionCommands(VkRScollectionCommands& collcmds, uint32_t numChunks)
+{
+    const uint32_t MAX_FRAMES_IN_FLIGHT = VkRScontext::MAX_FRAMES_IN_FLIGHT;
+    const uint32_t numWorkers = irecordingWorkers.size();
+    
+    collcmds.commandBuffers.resize(numChunks * MAX_FRAMES_IN_FLIGHT);
+    collcmds.chunkPools.resize(numChunks);
+    collcmds.chunkWorkers.resize(numChunks);
+    collcmds.recordedVersions.assign(MAX_FRAMES_IN_FLIGHT, VkRScollectionCommands::INVALID_VERSION);
+    for (uint32_t c = 0; c < numChunks; c++)
+    {
+        //chunks are spread round robin so that a large collection is recorded by several workers
+        const uint32_t worker = numWorkers > 0 ? inextRecordingWorker++ % numWorkers : 0;
+        collcmds.chunkWorkers[c] = worker;
+        collcmds.chunkPools[c] = numWorkers > 0 ? irecordingCommandPools[worker] : iinstance.commandPool;
+        
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = collcmds.chunkPools[c];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+
+        const VkResult allocRes = vkAllocateCommandBuffers(iinstance.device, &allocInfo, &collcmds.commandBuffers[c * MAX_FRAMES_IN_FLIGHT]);
+        if (allocRes != VK_SUCCESS) 
+        {
+            throw std::runtime_error("failed to allocate secondary command buffers!");
+        }
+    }
+}
+
+void VkRenderSystem::freeCollectionCommands(VkRScollectionCommands& collcmds)
+{
+    if (!collcmds.chunkPools.empty())
+    {
+        //freed once pending, retiring is drained before recording so the worker pools are not in use then
+        const VkDevice device = iinstance.device;
+        const std::vector<VkCommandPool> chunkPools = collcmds.chunkPools;
+        const std::vector<VkCommandBuffer> commandBuffers = collcmds.commandBuffers;
+        retire([device, chunkPools, commandBuffers]()
+        {
+            const uint32_t MAX_FRAMES_IN_FLIGHT = VkRScontext::MAX_FRAMES_IN_FLIGHT;
+            for (size_t c = 0; c < chunkPools.size(); c++)
+            {
+                vkFreeCommandBuffers(device, chunkPools[c], MAX_FRAMES_IN_FLIGHT, &commandBuffers[c * MAX_FRAMES_IN_FLIGHT]);
+            }
+        });
     }
+    collcmds.commandBuffers.clear();
+    collcmds.chunkPools.clear();
+    collcmds.chunkWorkers.clear();
+    collcmds.recordedVersions.clear();
 }
 
 void VkRenderSystem::contextDrawCollections(VkRScontext& ctx, VkRSview& view, const RScollectionID* collectionIDs, uint32_t numCollections)
@@ -1434,12 +2265,22 @@ void VkRenderSystem::contextDrawCollections(VkRScontext& ctx, VkRSview& view, co
     //TODO: debugging purpose
     //std::cout<<"rendering view name: "<<view.view.name<<std::endl;
     const VkDevice& device = iinstance.device;
-    uint32_t currentFrame = view.currentFrame;
+    pollPipelineCompiles();
+    //the view may have been drawn last by a context with more frames in flight
+    uint32_t currentFrame = view.currentFrame % ctx.framesInFlight;
     const VkFence inflightFence = ctx.inFlightFences[currentFrame];
     const VkSemaphore imageAvailableSemaphore = ctx.imageAvailableSemaphores[currentFrame];
     const VkSemaphore renderFinishedSemaphore = ctx.renderFinishedSemaphores[currentFrame];
 
     vkWaitForFences(device, 1, &inflightFence, VK_TRUE, UINT64_MAX);
+    //the spatial store and instance slots of this frame slot may still be read by another context's frame
+    waitForFrame(currentFrame);
+    drainRetireQueue(false);
+    //pending uploads are submitted ahead of the frame, the barrier closing their batch makes them visible to it
+    pollUploads(false);
+    streamTextures();
+    stageGeometryDataUpdates();
+    flushUploads();
 
     uint32_t imageIndex;
     VkResult res = vkAcquireNextImageKHR(device, view.swapChain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
@@ -1448,6 +2289,7 @@ void VkRenderSystem::contextDrawCollections(VkRScontext& ctx, VkRSview& view, co
     vkResetFences(device, 1, &inflightFence);
     
     updateUniformBuffer(view, currentFrame);
+    flushSpatials(currentFrame);
     
     const VkCommandBuffer commandBuffer = view.commandBuffers[currentFrame];
     vkResetCommandBuffer(commandBuffer, 0);
@@ -1475,6 +2317,8 @@ void VkRenderSystem::contextDrawCollections(VkRScontext& ctx, VkRSview& view, co
     {
         throw std::runtime_error("failed to submit draw command buffer!");
     }
+    iframeFences[currentFrame] = inflightFence;
+    ipendingFences[inflightFence] = ++isubmitSerial;
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1488,7 +2332,7 @@ void VkRenderSystem::contextDrawCollections(VkRScontext& ctx, VkRSview& view, co
     presentInfo.pResults = nullptr;
 
     res = vkQueuePresentKHR(iinstance.presentQueue, &presentInfo);
-    view.currentFrame = (currentFrame + 1) % VkRScontext::MAX_FRAMES_IN_FLIGHT;
+    view.currentFrame = (currentFrame + 1) % ctx.framesInFlight;
 }
 
 RSresult VkRenderSystem::contextDrawCollections(const RScontextID& ctxID, const RSviewID& viewID, const RScollectionID* collectionIDs, const uint32_t numCollections)
@@ -1504,11 +2348,6 @@ RSresult VkRenderSystem::contextDrawCollections(const RScontextID& ctxID, const
             VkRSview& view = iviewMap[viewID];
             
             contextDrawCollections(ctx, view, collectionIDs, numCollections);
-
-            VkResult res = vkDeviceWaitIdle(iinstance.device);
-            if (res != VK_SUCCESS) {
-                throw std::runtime_error("Failed to wait for device to become idle");
-            }
         }
     }
     
@@ -1537,10 +2376,9 @@ void VkRenderSystem::cleanupSwapChain(VkRSview& view)
 
     vkDestroyImageView(iinstance.device, view.depthImageView, nullptr);
     vkDestroyImage(iinstance.device, view.depthImage, nullptr);
-    vkFreeMemory(iinstance.device, view.depthImageMemory, nullptr);
+    iallocator.free(view.depthImageMemory);
     view.depthImageView = VK_NULL_HANDLE;
     view.depthImage = VK_NULL_HANDLE;
-    view.depthImageMemory = VK_NULL_HANDLE;
 
     for (auto framebuffer : view.swapChainFramebuffers) 
     {
@@ -1554,7 +2392,7 @@ void VkRenderSystem::cleanupSwapChain(VkRSview& view)
     vkDestroySwapchainKHR(iinstance.device, view.swapChain, nullptr);
 }
 
-VkImageView VkRenderSystem::createImageView(VkImage image, VkImageViewType imageViewType, VkFormat format, VkImageAspectFlags aspectFlags) 
+VkImageView VkRenderSystem::createImageView(VkImage image, VkImageViewType imageViewType, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) 
 {
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1563,7 +2401,7 @@ VkImageView VkRenderSystem::createImageView(VkImage image, VkImageViewType image
     viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = aspectFlags;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
     if (imageViewType == VK_IMAGE_VIEW_TYPE_2D) 
@@ -1777,6 +2615,12 @@ void VkRenderSystem::recreateSwapchain(VkRScontext& ctx, VkRSview& view)
         createDepthResources(view);
         createFramebuffers(view);
         
+        //recorded collections carry the old viewport and scissor
+        for (const auto& iter : view.collectionCommands)
+        {
+            invalidateCollectionCommands(view, iter.first);
+        }
+        
         vkDeviceWaitIdle(iinstance.device);
         
         ctx.resized = false;
@@ -1927,18 +2771,47 @@ void VkRenderSystem::createRenderpass(VkRSview& view)
     }
 }
 
-void VkRenderSystem::createGraphicsPipeline(VkRScollection& collection, VkRScollectionInstance& collinst, VkRSdrawCommand& drawcmd) 
+VkPipelineLayout VkRenderSystem::createPipelineLayout(const VkRSpipelineKey& key)
 {
-    if(!appearanceAvailable(drawcmd.appID))
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
+    VkDescriptorSetLayout viewDSL = VkRSfactory::getDescriptorLayout(DescriptorLayoutType::dltViewDefault);
+    descriptorSetLayouts.push_back(viewDSL);
+    if(key.appearanceLayout != VK_NULL_HANDLE)
     {
-        throw std::runtime_error("invalid appearance ID");
-        return;
+        descriptorSetLayouts.push_back(key.appearanceLayout);
     }
+    if(key.instanced)
+    {
+        descriptorSetLayouts.push_back(VkRSfactory::getDescriptorLayout(DescriptorLayoutType::dltInstanceSlots));
+    }
+
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+
+    //slot of the spatial in the spatial store and the decoding of the vertex attributes, pushed by every draw
+    VkPushConstantRange pushConstant{};
+    pushConstant.offset = 0;
+    pushConstant.size = sizeof(VkRSdrawConstants);
+    pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
     
-    VkRSappearance& vkrsapp = iappearanceMap[drawcmd.appID];
-    const RSshaderTemplate shaderTemplate = vkrsapp.appInfo.shaderTemplate;
-    
-    const VkRSshader& vkrsshader = ishaderModuleMap[shaderTemplate];
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkResult pipelineLayoutResult = vkCreatePipelineLayout(iinstance.device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+    if (pipelineLayoutResult != VK_SUCCESS) 
+    {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+    return pipelineLayout;
+}
+
+VkRSpipelineCompile VkRenderSystem::compileGraphicsPipeline(const VkRSpipelineKey& key, VkPipelineLayout pipelineLayout) 
+{
+    //runs on the pipeline workers, so everything is taken from the key rather than from the resource maps
+    assert(key.shaderTemplate != RSshaderTemplate::stMax && "shader template has no instanced variant");
+    const VkRSshader& vkrsshader = ishaderModuleMap.at(key.shaderTemplate);
     VkShaderModule vertShaderModule = vkrsshader.vert;
     VkShaderModule fragShaderModule = vkrsshader.frag;
 
@@ -1967,11 +2840,19 @@ void VkRenderSystem::createGraphicsPipeline(VkRScollection& collection, VkRScoll
     dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
     dynamicState.pDynamicStates = dynamicStates.data();
     
-    VkRSgeometryData& gdata = igeometryDataMap[collinst.instInfo.gdataID];
+    std::vector<RSvertexAttribute> attributes = key.attributes;
+    RSvertexAttribsInfo attributesInfo;
+    attributesInfo.numVertexAttribs = static_cast<uint32_t>(attributes.size());
+    attributesInfo.attributes = attributes.data();
+    attributesInfo.settings = key.settings;
+    for (size_t i = 0; i < attributes.size(); i++) 
+    {
+        attributesInfo.formats[static_cast<uint32_t>(attributes[i])] = key.formats[i];
+    }
     
     //At a minimum all shaders must have the following vertex attributes defined and corresponding buffers bound.
-    const std::vector<VkVertexInputBindingDescription> bindings = getBindingDescription(gdata.attributesInfo);
-    const std::vector<VkVertexInputAttributeDescription> attribs = getAttributeDescriptions(gdata.attributesInfo);
+    const std::vector<VkVertexInputBindingDescription> bindings = getBindingDescription(attributesInfo);
+    const std::vector<VkVertexInputAttributeDescription> attribs = getAttributeDescriptions(attributesInfo);
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -1982,7 +2863,7 @@ void VkRenderSystem::createGraphicsPipeline(VkRScollection& collection, VkRScoll
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = drawcmd.primTopology;
+    inputAssembly.topology = key.topology;
     inputAssembly.primitiveRestartEnable = VK_FALSE;
     
     static const VkExtent2D DEFAULT_SWAPCHAIN_EXTENT = {800, 600};
@@ -2009,11 +2890,11 @@ void VkRenderSystem::createGraphicsPipeline(VkRScollection& collection, VkRScoll
     rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
     rasterizer.depthClampEnable = VK_FALSE;
     rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    if (drawcmd.primTopology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_LINE_STRIP || drawcmd.primTopology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_LINE_LIST) 
+    if (key.topology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_LINE_STRIP || key.topology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_LINE_LIST) 
     {
         rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
     }
-    else if (drawcmd.primTopology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_POINT_LIST) 
+    else if (key.topology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_POINT_LIST) 
     {
         rasterizer.polygonMode = VK_POLYGON_MODE_POINT;
     }
@@ -2021,8 +2902,8 @@ void VkRenderSystem::createGraphicsPipeline(VkRScollection& collection, VkRScoll
     {
         rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
     }
-    rasterizer.lineWidth = drawcmd.state.lnstate.lineWidth;
-    if (drawcmd.primTopology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN || drawcmd.primTopology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST || drawcmd.primTopology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP) 
+    rasterizer.lineWidth = key.lineWidth;
+    if (key.topology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN || key.topology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST || key.topology == VkPrimitiveTopology::VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP) 
     {
         rasterizer.cullMode = VK_CULL_MODE_NONE;
     }
@@ -2066,46 +2947,11 @@ void VkRenderSystem::createGraphicsPipeline(VkRScollection& collection, VkRScoll
     colorBlending.blendConstants[2] = 0.0f; // Optional
     colorBlending.blendConstants[3] = 0.0f; // Optional
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
-    VkDescriptorSetLayout viewDSL = VkRSfactory::getDescriptorLayout(DescriptorLayoutType::dltViewDefault);
-    descriptorSetLayouts.push_back(viewDSL);
-    if(vkrsapp.descriptorSetLayout != VK_NULL_HANDLE)
-    {
-        descriptorSetLayouts.push_back(vkrsapp.descriptorSetLayout);
-    }
-
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-
-    const RSspatialID& spatialID = collinst.instInfo.spatialID;
-    VkPushConstantRange pushConstant{};
-    pushConstant.offset = 0;
-    pushConstant.size = sizeof(RSspatial);
-    pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    if (spatialAvailable(spatialID)) 
-    {
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
-    } 
-    else
-    {
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
-        pipelineLayoutInfo.pPushConstantRanges = nullptr;
-    }
-    
-    VkResult pipelineLayoutResult = vkCreatePipelineLayout(iinstance.device, &pipelineLayoutInfo, nullptr, &drawcmd.pipelineLayout);
-    if (pipelineLayoutResult != VK_SUCCESS) 
-    {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
-    
     VkPipelineDepthStencilStateCreateInfo depthStencil{};
     depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencil.depthTestEnable = VK_TRUE;
     depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = getDepthCompare(drawcmd.state.depthState.depthFunc);
+    depthStencil.depthCompareOp = getDepthCompare(key.depthFunc);
     depthStencil.depthBoundsTestEnable = VK_FALSE;
     depthStencil.minDepthBounds = 0.0f;
     depthStencil.maxDepthBounds = 1.0f;
@@ -2126,115 +2972,793 @@ void VkRenderSystem::createGraphicsPipeline(VkRScollection& collection, VkRScoll
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDynamicState = &dynamicState;
 
-    pipelineInfo.layout = drawcmd.pipelineLayout;
+    pipelineInfo.layout = pipelineLayout;
 
-    pipelineInfo.renderPass = VkRSfactory::getRenderPass(RenderPassType::rptViewSimple);
+    pipelineInfo.renderPass = key.renderPass;
     pipelineInfo.subpass = 0;
 
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
-
-    const VkResult graphicsPipelineResult = vkCreateGraphicsPipelines(iinstance.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &drawcmd.graphicsPipeline);
+    
+    VkPipelineCreationFeedback creationFeedback{};
+    std::array<VkPipelineCreationFeedback, 2> stageFeedbacks{};
+    VkPipelineCreationFeedbackCreateInfo feedbackInfo{};
+    feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+    feedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+    feedbackInfo.pipelineStageCreationFeedbackCount = static_cast<uint32_t>(stageFeedbacks.size());
+    feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedbacks.data();
+    if (icreationFeedback) 
+    {
+        pipelineInfo.pNext = &feedbackInfo;
+    }
+
+    //the pipeline cache is internally synchronized, so workers compile into it concurrently
+    VkRSpipelineCompile compiled;
+    const auto start = std::chrono::steady_clock::now();
+    const VkResult graphicsPipelineResult = vkCreateGraphicsPipelines(iinstance.device, ipipelineCache, 1, &pipelineInfo, nullptr, &compiled.pipeline);
+    compiled.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     if (graphicsPipelineResult != VK_SUCCESS) 
     {
-        throw std::runtime_error("failed to create graphics pipeline!");
+        compiled.pipeline = VK_NULL_HANDLE;
+        return compiled;
     }
+    
+    const VkPipelineCreationFeedbackFlags cacheHit = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT | VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT;
+    compiled.cacheHit = (creationFeedback.flags & cacheHit) == cacheHit;
+    return compiled;
 }
 
-void VkRenderSystem::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memProperties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) 
+void VkRenderSystem::createPipelineCache(const std::string& path)
 {
-    VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = size;
-    bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    bufferInfo.flags = 0;
-
-    VkResult res = vkCreateBuffer(iinstance.device, &bufferInfo, nullptr, &buffer);
-    if (res != VK_SUCCESS) 
-    {
-        throw std::runtime_error("failed to create a buffer!");
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(iinstance.physicalDevice, &properties);
+    //creation feedback is core in 1.3
+    icreationFeedback = VK_API_VERSION_MAJOR(properties.apiVersion) > 1 || VK_API_VERSION_MINOR(properties.apiVersion) >= 3;
+    
+    //data written by another device or driver is dropped here, some drivers do not validate it themselves
+    std::vector<char> data;
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!path.empty() && file.is_open()) 
+    {
+        const size_t fileSize = static_cast<size_t>(file.tellg());
+        VkRSpipelineCacheHeader header;
+        file.seekg(0);
+        if (fileSize >= sizeof(header) && file.read(reinterpret_cast<char*>(&header), sizeof(header))) 
+        {
+            const bool matches = header.magic == VkRSpipelineCacheHeader::MAGIC && header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+                header.driverVersion == properties.driverVersion && std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+                header.dataSize == fileSize - sizeof(header);
+            if (matches) 
+            {
+                data.resize(static_cast<size_t>(header.dataSize));
+                if (!file.read(data.data(), data.size())) 
+                {
+                    data.clear();
+                }
+            }
+        }
+    }
+    
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+    VkResult res = vkCreatePipelineCache(iinstance.device, &cacheInfo, nullptr, &ipipelineCache);
+    if (res != VK_SUCCESS && !data.empty()) 
+    {
+        //a rejected file only costs the warm start
+        data.clear();
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        res = vkCreatePipelineCache(iinstance.device, &cacheInfo, nullptr, &ipipelineCache);
     }
-
-    VkMemoryRequirements memRequirements{};
-    vkGetBufferMemoryRequirements(iinstance.device, buffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, memProperties);
-
-    res = vkAllocateMemory(iinstance.device, &allocInfo, nullptr, &bufferMemory);
     if (res != VK_SUCCESS) 
     {
-        throw std::runtime_error("failed to allocate vertex buffer memory");
+        throw std::runtime_error("failed to create the pipeline cache!");
     }
-
-    res = vkBindBufferMemory(iinstance.device, buffer, bufferMemory, 0);
+    ipipelineStats.cacheLoaded = !data.empty();
 }
 
-uint32_t VkRenderSystem::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) 
+void VkRenderSystem::disposePipelineCache(const std::string& path)
 {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(iinstance.physicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    size_t dataSize = 0;
+    if (!path.empty() && vkGetPipelineCacheData(iinstance.device, ipipelineCache, &dataSize, nullptr) == VK_SUCCESS && dataSize > 0) 
     {
-        if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) 
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(iinstance.device, ipipelineCache, &dataSize, data.data()) == VK_SUCCESS) 
         {
-            return i;
+            VkPhysicalDeviceProperties properties{};
+            vkGetPhysicalDeviceProperties(iinstance.physicalDevice, &properties);
+            VkRSpipelineCacheHeader header;
+            header.vendorID = properties.vendorID;
+            header.deviceID = properties.deviceID;
+            header.driverVersion = properties.driverVersion;
+            std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+            header.dataSize = dataSize;
+            
+            //written next to the old file and swapped in, so that a failed write never leaves a truncated cache behind
+            const std::string tempPath = path + ".tmp";
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(data.data(), dataSize);
+            file.close();
+            if (file) 
+            {
+                std::remove(path.c_str());
+                std::rename(tempPath.c_str(), path.c_str());
+            }
         }
     }
-
-    throw std::runtime_error("failed to find suitable memory type!");
-}
-
-VkCommandBuffer VkRenderSystem::beginSingleTimeCommands() 
-{
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = iinstance.commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer{};
-    vkAllocateCommandBuffers(iinstance.device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    return commandBuffer;
+    
+    vkDestroyPipelineCache(iinstance.device, ipipelineCache, nullptr);
+    ipipelineCache = VK_NULL_HANDLE;
 }
 
-void VkRenderSystem::endSingleTimeCommands(VkCommandBuffer commandBuffer) 
+VkRSpipelineKey VkRenderSystem::getPipelineKey(const VkRScollectionInstance& collinst, const VkRSdrawCommand& drawcmd, bool instanced)
 {
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(iinstance.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(iinstance.graphicsQueue);
-
-    vkFreeCommandBuffers(iinstance.device, iinstance.commandPool, 1, &commandBuffer);
+    const VkRSappearance& vkrsapp = iappearanceMap.at(drawcmd.appID);
+    const VkRSgeometryData& gdata = igeometryDataMap.at(collinst.instInfo.gdataID);
+    
+    //point size is written by the shaders, so it is not part of the pipeline state
+    VkRSpipelineKey key;
+    key.shaderTemplate = instanced ? getInstancedShaderTemplate(vkrsapp.appInfo.shaderTemplate) : vkrsapp.appInfo.shaderTemplate;
+    key.instanced = instanced;
+    key.settings = gdata.attributesInfo.settings;
+    for (uint32_t i = 0; i < gdata.attributesInfo.numVertexAttribs; i++) 
+    {
+        const RSvertexAttribute attrib = gdata.attributesInfo.attributes[i];
+        key.attributes.push_back(attrib);
+        key.formats.push_back(gdata.attributesInfo.getFormat(attrib));
+    }
+    key.topology = drawcmd.primTopology;
+    key.depthFunc = drawcmd.state.depthState.depthFunc;
+    key.lineWidth = drawcmd.state.lnstate.lineWidth;
+    key.appearanceLayout = vkrsapp.descriptorSetLayout;
+    key.renderPass = VkRSfactory::getRenderPass(RenderPassType::rptViewSimple);
+    return key;
 }
 
-
-void VkRenderSystem::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) 
+void VkRenderSystem::acquireGraphicsPipeline(VkRScollection& collection, VkRScollectionInstance& collinst, VkRSdrawCommand& drawcmd, bool instanced)
 {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    if(!appearanceAvailable(drawcmd.appID))
     {
-        VkBufferCopy copyRegion{};
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+        throw std::runtime_error("invalid appearance ID");
     }
-    endSingleTimeCommands(commandBuffer);
-}
+    
+    VkRSpipelineKey key = getPipelineKey(collinst, drawcmd, instanced);
+    const auto& iter = ipipelineRegistry.find(key);
+    if (iter != ipipelineRegistry.end()) 
+    {
+        iter->second.refCount++;
+        ipipelineStats.registryHits++;
+        drawcmd.pipeline = &iter->second;
+        drawcmd.pipelineLayout = iter->second.layout;
+        return;
+    }
+    
+    //the layout is cheap and needed to bind descriptor sets, so only the pipeline itself is compiled in the background
+    VkRSpipeline entry;
+    entry.layout = createPipelineLayout(key);
+    entry.refCount = 1;
+    const auto& inserted = ipipelineRegistry.emplace(std::move(key), entry).first;
+    VkRSpipeline& pipeline = inserted->second;
+    pipeline.key = &inserted->first;
+    drawcmd.pipeline = &pipeline;
+    drawcmd.pipelineLayout = pipeline.layout;
+    
+    if (ipipelineWorkers.size() == 0) 
+    {
+        VkRSpipelineCompile compiled = compileGraphicsPipeline(*pipeline.key, pipeline.layout);
+        compiled.entry = &pipeline;
+        applyCompiledPipeline(compiled);
+        return;
+    }
+    
+    //until it is compiled, draw with a ready pipeline that only differs in line width, a different depth function would change what is occluded
+    for (auto& other : ipipelineRegistry) 
+    {
+        if (other.second.ready && other.first.isCompatible(*pipeline.key)) 
+        {
+            other.second.refCount++;
+            pipeline.fallback = &other.second;
+            break;
+        }
+    }
+    
+    //the compile holds a reference, so the entry outlives its draws until the compiled pipeline is applied
+    pipeline.refCount++;
+    ipipelineStats.pipelinesPending++;
+    VkRSpipeline* entryPtr = &pipeline;
+    const VkPipelineLayout pipelineLayout = pipeline.layout;
+    ipipelineWorkers.submit(inextPipelineWorker, [this, entryPtr, pipelineLayout, key = *pipeline.key]()
+    {
+        VkRSpipelineCompile compiled = compileGraphicsPipeline(key, pipelineLayout);
+        compiled.entry = entryPtr;
+        std::lock_guard<std::mutex> lock(icompiledMutex);
+        icompiledPipelines.push_back(compiled);
+    });
+    inextPipelineWorker = (inextPipelineWorker + 1) % ipipelineWorkers.size();
+}
+
+void VkRenderSystem::releaseGraphicsPipeline(VkRSpipeline* pipeline)
+{
+    assert(pipeline != nullptr && pipeline->key != nullptr && "pipeline is not in the registry");
+    if (pipeline == nullptr) 
+    {
+        return;
+    }
+    
+    pipeline->refCount--;
+    if (pipeline->refCount == 0) 
+    {
+        //frames in flight may still use it
+        retirePipeline(pipeline->pipeline, pipeline->layout);
+        const VkRSpipelineKey key = *pipeline->key;
+        ipipelineRegistry.erase(key);
+    }
+}
+
+void VkRenderSystem::applyCompiledPipeline(const VkRSpipelineCompile& compiled)
+{
+    if (compiled.pipeline == VK_NULL_HANDLE) 
+    {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+    
+    VkRSpipeline& pipeline = *compiled.entry;
+    pipeline.pipeline = compiled.pipeline;
+    pipeline.ready = true;
+    ipipelineStats.pipelinesCreated++;
+    ipipelineStats.creationMilliseconds += compiled.milliseconds;
+    if (compiled.cacheHit) 
+    {
+        ipipelineStats.pipelineCacheHits++;
+    }
+    
+    if (pipeline.fallback != nullptr) 
+    {
+        releaseGraphicsPipeline(pipeline.fallback);
+        pipeline.fallback = nullptr;
+    }
+}
+
+void VkRenderSystem::pollPipelineCompiles()
+{
+    std::vector<VkRSpipelineCompile> compiledPipelines;
+    {
+        std::lock_guard<std::mutex> lock(icompiledMutex);
+        compiledPipelines.swap(icompiledPipelines);
+    }
+    if (compiledPipelines.empty()) 
+    {
+        return;
+    }
+    
+    for (const VkRSpipelineCompile& compiled : compiledPipelines) 
+    {
+        applyCompiledPipeline(compiled);
+        ipipelineStats.pipelinesPending--;
+        //drop the reference of the compile
+        releaseGraphicsPipeline(compiled.entry);
+    }
+    
+    //collections drawn with fallbacks or with draws skipped are re-recorded with the pipelines ready now
+    for (auto& iter : icollectionMap) 
+    {
+        VkRScollection& collection = iter.second;
+        if (collection.pipelinesPending) 
+        {
+            collection.pipelinesPending = !pipelinesReady(collection);
+            collection.version++;
+        }
+    }
+}
+
+bool VkRenderSystem::pipelinesReady(const VkRScollection& collection) const
+{
+    for (const VkRSdrawBatch& batch : collection.batches) 
+    {
+        if (batch.instanced) 
+        {
+            if (!batch.pipeline->ready) 
+            {
+                return false;
+            }
+            continue;
+        }
+        
+        for (uint32_t slot = batch.firstSlot; slot < batch.firstSlot + batch.numSlots; slot++) 
+        {
+            if (!collection.drawList[slot].pipeline->ready) 
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void VkRenderSystem::disposePipelineRegistry()
+{
+    //pipelines of collections the client never disposed
+    for (const auto& iter : ipipelineRegistry) 
+    {
+        vkDestroyPipeline(iinstance.device, iter.second.pipeline, nullptr);
+        vkDestroyPipelineLayout(iinstance.device, iter.second.layout, nullptr);
+    }
+    ipipelineRegistry.clear();
+}
+
+void VkRenderSystem::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memProperties, VkBuffer& buffer, VkRSallocation& bufferMemory, VkRSallocationType allocationType) 
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    bufferInfo.flags = 0;
+
+    VkResult res = vkCreateBuffer(iinstance.device, &bufferInfo, nullptr, &buffer);
+    if (res != VK_SUCCESS) 
+    {
+        throw std::runtime_error("failed to create a buffer!");
+    }
+
+    VkMemoryRequirements memRequirements{};
+    vkGetBufferMemoryRequirements(iinstance.device, buffer, &memRequirements);
+
+    bufferMemory = iallocator.allocate(memRequirements, memProperties, allocationType, false);
+
+    res = vkBindBufferMemory(iinstance.device, buffer, bufferMemory.memory, bufferMemory.offset);
+}
+
+VkCommandBuffer VkRenderSystem::getUploadCommandBuffer() 
+{
+    if (iuploadBatch.commandBuffer != VK_NULL_HANDLE)
+    {
+        return iuploadBatch.commandBuffer;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = iinstance.transferCommandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkResult res = vkAllocateCommandBuffers(iinstance.device, &allocInfo, &iuploadBatch.commandBuffer);
+    if (res != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate upload command buffer");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(iuploadBatch.commandBuffer, &beginInfo);
+    iuploadBatch.serial = ++iuploadSerial;
+
+    return iuploadBatch.commandBuffer;
+}
+
+void VkRenderSystem::createStagingRing(VkDeviceSize size)
+{
+    istagingRing.init(size);
+    if (size == 0)
+    {
+        return;
+    }
+
+    //updates of finalized geometry copy out of the ring on the graphics queue, uploads on the transfer queue
+    const uint32_t queueFamilies[] = { iinstance.queueFamilyIndices.graphicsFamily.value(), iinstance.queueFamilyIndices.transferFamily.value_or(0) };
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (iinstance.queueFamilyIndices.hasDedicatedTransfer())
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = queueFamilies;
+    }
+
+    VkResult res = vkCreateBuffer(iinstance.device, &bufferInfo, nullptr, &istagingRingBuffer);
+    if (res != VK_SUCCESS) 
+    {
+        throw std::runtime_error("failed to create the staging ring buffer");
+    }
+
+    VkMemoryRequirements memRequirements{};
+    vkGetBufferMemoryRequirements(iinstance.device, istagingRingBuffer, &memRequirements);
+    istagingRingMemory = iallocator.allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VkRSallocationType::atGeneral, false);
+    vkBindBufferMemory(iinstance.device, istagingRingBuffer, istagingRingMemory.memory, istagingRingMemory.offset);
+}
+
+void VkRenderSystem::disposeStagingRing()
+{
+    vkDestroyBuffer(iinstance.device, istagingRingBuffer, nullptr);
+    iallocator.free(istagingRingMemory);
+    istagingRingBuffer = VK_NULL_HANDLE;
+    istagingRing.init(0);
+}
+
+VkRSstagingRange VkRenderSystem::acquireStaging(VkDeviceSize size)
+{
+    //suits buffer to image copies of every texel size, also on transfer queues
+    static const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+    //nothing to copy, and a buffer of its own could not be created with a size of zero
+    VkRSstagingRange staging;
+    if (size == 0)
+    {
+        return staging;
+    }
+
+    staging.size = size;
+    if (size <= istagingRing.size())
+    {
+        while (true)
+        {
+            if (istagingRing.allocate(size, STAGING_ALIGNMENT, staging.offset))
+            {
+                staging.buffer = istagingRingBuffer;
+                staging.mapped = static_cast<char*>(istagingRingMemory.mapped) + staging.offset;
+                return staging;
+            }
+
+            //the oldest uploads recycle their ranges once complete, unless the ring is held by data not finalized yet
+            flushUploads();
+            if (ipendingUploads.empty())
+            {
+                break;
+            }
+            waitForUpload(ipendingUploads.front().serial);
+        }
+    }
+
+    //too large for the ring or the ring is exhausted, stage in a buffer of its own
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging.buffer, staging.memory, VkRSallocationType::atTransient);
+    staging.mapped = staging.memory.mapped;
+    return staging;
+}
+
+void VkRenderSystem::releaseStagingAfterUpload(VkRSstagingRange& staging)
+{
+    //caps the staging memory held by a single batch during large loads
+    static const VkDeviceSize MAX_BATCH_STAGING_BYTES = 256ull * 1024 * 1024;
+
+    if (!staging.isValid())
+    {
+        return;
+    }
+
+    assert(iuploadBatch.commandBuffer != VK_NULL_HANDLE && "staging memory is released after recording its copies");
+    iuploadBatch.stagingBytes += staging.size;
+    if (staging.buffer == istagingRingBuffer)
+    {
+        istagingRing.release(staging.offset, iuploadBatch.serial);
+    }
+    else
+    {
+        const VkDevice device = iinstance.device;
+        const VkBuffer buffer = staging.buffer;
+        VkRSallocation memory = staging.memory;
+        iuploadBatch.onComplete.push_back([this, device, buffer, memory]() mutable
+        {
+            vkDestroyBuffer(device, buffer, nullptr);
+            iallocator.free(memory);
+        });
+    }
+    staging = VkRSstagingRange();
+
+    if (iuploadBatch.stagingBytes > MAX_BATCH_STAGING_BYTES)
+    {
+        flushUploads();
+    }
+}
+
+void VkRenderSystem::discardStaging(VkRSstagingRange& staging)
+{
+    if (!staging.isValid())
+    {
+        return;
+    }
+
+    //never copied from, so it can be recycled right away
+    if (staging.buffer == istagingRingBuffer)
+    {
+        istagingRing.release(staging.offset, 0);
+        istagingRing.reclaim(icompletedUploadSerial);
+    }
+    else
+    {
+        vkDestroyBuffer(iinstance.device, staging.buffer, nullptr);
+        iallocator.free(staging.memory);
+    }
+    staging = VkRSstagingRange();
+}
+
+void VkRenderSystem::flushUploads() 
+{
+    const VkCommandBuffer commandBuffer = iuploadBatch.commandBuffer;
+    if (commandBuffer == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    const VkDevice device = iinstance.device;
+    const bool dedicatedTransfer = iinstance.queueFamilyIndices.hasDedicatedTransfer();
+    const VkPipelineStageFlags consumerStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    const VkAccessFlags consumerAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    if (dedicatedTransfer)
+    {
+        //release the written resources to the graphics family, the matching acquires are recorded below
+        std::vector<VkBufferMemoryBarrier> bufferReleases = iuploadBatch.bufferAcquires;
+        for (VkBufferMemoryBarrier& barrier : bufferReleases)
+        {
+            barrier.dstAccessMask = 0;
+        }
+        std::vector<VkImageMemoryBarrier> imageReleases = iuploadBatch.imageAcquires;
+        for (VkImageMemoryBarrier& barrier : imageReleases)
+        {
+            barrier.dstAccessMask = 0;
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 
+            static_cast<uint32_t>(bufferReleases.size()), bufferReleases.data(), static_cast<uint32_t>(imageReleases.size()), imageReleases.data());
+    }
+    else
+    {
+        recordBufferUpdates(commandBuffer);
+
+        //later submissions on the queue, i.e. the frames drawing the uploaded data, see the copies
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = consumerAccess;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, consumerStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+    vkEndCommandBuffer(commandBuffer);
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkResult res = vkCreateFence(device, &fenceInfo, nullptr, &iuploadBatch.fence);
+    if (res != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create upload fence");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    if (dedicatedTransfer)
+    {
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        res = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &iuploadBatch.transferComplete);
+        if (res != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upload semaphore");
+        }
+
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &iuploadBatch.transferComplete;
+        res = vkQueueSubmit(iinstance.transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        if (res != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit upload command buffer");
+        }
+
+        //the graphics queue acquires the resources ahead of the frames drawing them
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = iinstance.commandPool;
+        allocInfo.commandBufferCount = 1;
+        res = vkAllocateCommandBuffers(device, &allocInfo, &iuploadBatch.acquireCommandBuffer);
+        if (res != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate upload acquire command buffer");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(iuploadBatch.acquireCommandBuffer, &beginInfo);
+        //only the consumers of the acquired resources and the buffer update copies wait for the transfer queue,
+        //the acquire barrier starts at the same stages so that it chains with the semaphore wait
+        const VkPipelineStageFlags waitStage = consumerStages | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        vkCmdPipelineBarrier(iuploadBatch.acquireCommandBuffer, waitStage, waitStage, 0, 0, nullptr, 
+            static_cast<uint32_t>(iuploadBatch.bufferAcquires.size()), iuploadBatch.bufferAcquires.data(), 
+            static_cast<uint32_t>(iuploadBatch.imageAcquires.size()), iuploadBatch.imageAcquires.data());
+        if (!iuploadBatch.updates.empty())
+        {
+            recordBufferUpdates(iuploadBatch.acquireCommandBuffer);
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = consumerAccess;
+            vkCmdPipelineBarrier(iuploadBatch.acquireCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, consumerStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+        vkEndCommandBuffer(iuploadBatch.acquireCommandBuffer);
+
+        VkSubmitInfo acquireInfo{};
+        acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquireInfo.waitSemaphoreCount = 1;
+        acquireInfo.pWaitSemaphores = &iuploadBatch.transferComplete;
+        acquireInfo.pWaitDstStageMask = &waitStage;
+        acquireInfo.commandBufferCount = 1;
+        acquireInfo.pCommandBuffers = &iuploadBatch.acquireCommandBuffer;
+        res = vkQueueSubmit(iinstance.graphicsQueue, 1, &acquireInfo, iuploadBatch.fence);
+    }
+    else
+    {
+        res = vkQueueSubmit(iinstance.graphicsQueue, 1, &submitInfo, iuploadBatch.fence);
+    }
+
+    if (res != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit upload command buffer");
+    }
+
+    ipendingUploads.push_back(std::move(iuploadBatch));
+    iuploadBatch = VkRSuploadBatch();
+}
+
+void VkRenderSystem::recordBufferUpdates(VkCommandBuffer commandBuffer)
+{
+    if (iuploadBatch.updates.empty())
+    {
+        return;
+    }
+
+    //frames submitted earlier may still read the buffers, as vertex input or from shaders like the brick page tables,
+    //and copies of this batch may have written them
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    const VkPipelineStageFlags readerStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    vkCmdPipelineBarrier(commandBuffer, readerStages | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    for (const VkRSbufferUpdate& update : iuploadBatch.updates)
+    {
+        vkCmdCopyBuffer(commandBuffer, update.srcBuffer, update.dstBuffer, 1, &update.region);
+    }
+}
+
+void VkRenderSystem::pollUploads(bool wait) 
+{
+    while (!ipendingUploads.empty())
+    {
+        VkRSuploadBatch& batch = ipendingUploads.front();
+        if (wait)
+        {
+            vkWaitForFences(iinstance.device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        }
+        else if (vkGetFenceStatus(iinstance.device, batch.fence) != VK_SUCCESS)
+        {
+            //batches complete in submission order
+            break;
+        }
+
+        for (std::function<void()>& onComplete : batch.onComplete)
+        {
+            onComplete();
+        }
+        vkFreeCommandBuffers(iinstance.device, iinstance.transferCommandPool, 1, &batch.commandBuffer);
+        if (batch.acquireCommandBuffer != VK_NULL_HANDLE)
+        {
+            vkFreeCommandBuffers(iinstance.device, iinstance.commandPool, 1, &batch.acquireCommandBuffer);
+            vkDestroySemaphore(iinstance.device, batch.transferComplete, nullptr);
+        }
+        vkDestroyFence(iinstance.device, batch.fence, nullptr);
+        icompletedUploadSerial = batch.serial;
+        ipendingUploads.pop_front();
+    }
+    istagingRing.reclaim(icompletedUploadSerial);
+}
+
+void VkRenderSystem::waitForUpload(uint64_t serial) 
+{
+    if (isUploadComplete(serial))
+    {
+        return;
+    }
+
+    if (iuploadBatch.commandBuffer != VK_NULL_HANDLE && iuploadBatch.serial <= serial)
+    {
+        flushUploads();
+    }
+    while (!ipendingUploads.empty() && ipendingUploads.front().serial <= serial)
+    {
+        vkWaitForFences(iinstance.device, 1, &ipendingUploads.front().fence, VK_TRUE, UINT64_MAX);
+        pollUploads(false);
+    }
+}
+
+bool VkRenderSystem::isUploadComplete(uint64_t serial) const 
+{
+    return serial <= icompletedUploadSerial;
+}
+
+void VkRenderSystem::copyBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size) 
+{
+    VkCommandBuffer commandBuffer = getUploadCommandBuffer();
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+    if (iinstance.queueFamilyIndices.hasDedicatedTransfer())
+    {
+        //only the written range changes owner, other ranges of a shared geometry buffer stay with the graphics family
+        VkBufferMemoryBarrier acquire{};
+        acquire.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        acquire.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        acquire.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        acquire.srcQueueFamilyIndex = iinstance.queueFamilyIndices.transferFamily.value();
+        acquire.dstQueueFamilyIndex = iinstance.queueFamilyIndices.graphicsFamily.value();
+        acquire.buffer = dstBuffer;
+        acquire.offset = dstOffset;
+        acquire.size = size;
+        iuploadBatch.bufferAcquires.push_back(acquire);
+    }
+}
+
+VkRSgeometryRange VkRenderSystem::allocateGeometryRange(std::vector<VkRSsharedGeometryBuffer>& sharedBuffers, VkDeviceSize size, VkDeviceSize alignment, VkBufferUsageFlags usage)
+{
+    static const VkDeviceSize SHARED_VERTEX_BUFFER_SIZE = 64ull * 1024 * 1024;
+    static const VkDeviceSize SHARED_INDEX_BUFFER_SIZE = 16ull * 1024 * 1024;
+
+    VkRSgeometryRange range;
+    range.size = size;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(sharedBuffers.size()); i++)
+    {
+        if (sharedBuffers[i].ranges.allocate(size, alignment, range.offset))
+        {
+            range.bufferIndex = i;
+            return range;
+        }
+    }
+
+    //none of the shared buffers has room, add another one large enough for the request
+    VkDeviceSize bufferSize = (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) ? SHARED_INDEX_BUFFER_SIZE : SHARED_VERTEX_BUFFER_SIZE;
+    bufferSize = size > bufferSize ? size : bufferSize;
+    VkRSsharedGeometryBuffer sharedBuffer;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sharedBuffer.buffer, sharedBuffer.memory);
+    sharedBuffer.ranges.init(bufferSize);
+    const bool success = sharedBuffer.ranges.allocate(size, alignment, range.offset);
+    assert(success && "geometry range does not fit a new shared buffer");
+    range.bufferIndex = static_cast<uint32_t>(sharedBuffers.size());
+    sharedBuffers.push_back(std::move(sharedBuffer));
+    return range;
+}
+
+void VkRenderSystem::freeGeometryRange(std::vector<VkRSsharedGeometryBuffer>& sharedBuffers, VkRSgeometryRange& range)
+{
+    if (range.isValid())
+    {
+        sharedBuffers[range.bufferIndex].ranges.free(range.offset, range.size);
+        range = VkRSgeometryRange();
+    }
+}
+
+void VkRenderSystem::disposeSharedGeometryBuffers()
+{
+    for (std::vector<VkRSsharedGeometryBuffer>* sharedBuffers : { &isharedVertexBuffers, &isharedIndexBuffers })
+    {
+        for (VkRSsharedGeometryBuffer& sharedBuffer : *sharedBuffers)
+        {
+            vkDestroyBuffer(iinstance.device, sharedBuffer.buffer, nullptr);
+            iallocator.free(sharedBuffer.memory);
+        }
+        sharedBuffers->clear();
+    }
+}
 
 std::vector<VkVertexInputBindingDescription> VkRenderSystem::getBindingDescription(const RSvertexAttribsInfo& attribInfo) 
 {
@@ -2281,7 +3805,7 @@ std::vector<VkVertexInputAttributeDescription> VkRenderSystem::getAttributeDescr
         {
             case RSvertexAttributeSettings::vasInterleaved:
                 attributeDescriptions[i].binding = 0;
-                attributeDescriptions[i].offset = getOffset(attribInfo.numVertexAttribs, i);
+                attributeDescriptions[i].offset = getOffset(attribInfo, i);
                 break;
                 
             case RSvertexAttributeSettings::vasSeparate:
@@ -2291,7 +3815,7 @@ std::vector<VkVertexInputAttributeDescription> VkRenderSystem::getAttributeDescr
         }
         
         attributeDescriptions[i].location = i;//attribInfo.getBindingPoint(attrib);
-        attributeDescriptions[i].format = getVkFormat(attribInfo.attributes[i]);
+        attributeDescriptions[i].format = getVkFormat(attrib, attribInfo.getFormat(attrib));
     }
 
     return attributeDescriptions;
@@ -2302,8 +3826,41 @@ bool VkRenderSystem::geometryDataAvailable(const RSgeometryDataID& geomDataID)
     return geomDataID.isValid() && (igeometryDataMap.find(geomDataID) != igeometryDataMap.end());
 }
 
-RSresult VkRenderSystem::geometryDataCreate(RSgeometryDataID& outgdataID, uint32_t numVertices, uint32_t numIndices, const RSvertexAttribsInfo attributesInfo) 
+RSresult VkRenderSystem::geometryDataCreate(RSgeometryDataID& outgdataID, uint32_t numVertices, uint32_t numIndices, const RSvertexAttribsInfo attributesInfo, RSindexType indexType) 
 {
+    //validate before the ID and the attribute array are taken, so failures leave nothing behind
+    bool foundPosition = false;
+    for (uint32_t i = 0; i < attributesInfo.numVertexAttribs; i++) 
+    {
+        if (attributesInfo.attributes[i] == RSvertexAttribute::vaPosition) 
+        {
+            foundPosition = true;
+            break;
+        }
+    }
+    if (foundPosition == false) 
+    {
+        return RSresult::FAILURE;
+    }
+
+    //vertex buffers cannot be empty, unlike the index buffer which is left out without indices
+    assert(numVertices > 0 && "geometry data needs at least one vertex");
+    if (numVertices == 0) 
+    {
+        return RSresult::FAILURE;
+    }
+
+    for (uint32_t i = 0; i < attributesInfo.numVertexAttribs; i++) 
+    {
+        const RSvertexAttribute attrib = attributesInfo.attributes[i];
+        const bool supported = getVkFormat(attrib, attributesInfo.getFormat(attrib)) != VK_FORMAT_MAX_ENUM;
+        assert(supported && "vertex format is not supported for the attribute");
+        if (!supported) 
+        {
+            return RSresult::FAILURE;
+        }
+    }
+
     RSuint id;
     bool success = igeomDataIDpool.CreateID(id);
     assert(success && "failed to create a geometry data ID");
@@ -2312,37 +3869,43 @@ RSresult VkRenderSystem::geometryDataCreate(RSgeometryDataID& outgdataID, uint32
         VkRSgeometryData gdata;
         gdata.numVertices = numVertices;
         gdata.numIndices = numIndices;
+        gdata.indexType = indexType;
         gdata.attributesInfo = attributesInfo;
         //TODO: prefer to use a unique pointer. Perhaps keep a separate struct for internal representation of vertex attributes so its not exposed to client.
         gdata.attributesInfo.attributes = new RSvertexAttribute[attributesInfo.numVertexAttribs];
         std::memcpy(gdata.attributesInfo.attributes, attributesInfo.attributes, attributesInfo.numVertexAttribs * sizeof(RSvertexAttribute));
 
-        //Create buffer for position
-        bool foundPosition = false;
-        for (uint32_t i = 0; i < gdata.attributesInfo.numVertexAttribs; i++) 
-        {
-            if (gdata.attributesInfo.attributes[i] == RSvertexAttribute::vaPosition) 
-            {
-                foundPosition = true;
-                break;
-            }
-        }
-        if (foundPosition == false) 
-        {
-            return RSresult::FAILURE;
-        }
-
+        //dynamic data is written in place by the host, so it is neither staged nor placed in the shared buffers
+        gdata.dynamicBuffers = attributesInfo.usageHint != RSbufferUsageHint::buStatic;
+        gdata.sharedBuffers = iinitInfo.sharedGeometryBuffers && !gdata.dynamicBuffers;
+        const uint32_t numCopies = VkRSgeometryData::NUM_COPIES;
+        const VkMemoryPropertyFlags dynamicProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
         switch (gdata.attributesInfo.settings) 
         {
             case RSvertexAttributeSettings::vasInterleaved: 
             {
+                const VkDeviceSize stride = attributesInfo.sizeOfInterleavedAttrib();
+                VkDeviceSize vaBufferSize = numVertices * stride;
+                if (gdata.dynamicBuffers) 
+                {
+                    createBuffer(VkRSgeometryData::copyStride(vaBufferSize) * numCopies, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, dynamicProperties, gdata.interleaved.vaBuffer, gdata.interleaved.vaBufferMemory);
+                    break;
+                }
+
                 //create buffer for staging position vertex attribs
-                VkDeviceSize vaBufferSize = numVertices * attributesInfo.sizeOfInterleavedAttrib();
-                createBuffer(vaBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, gdata.interleaved.stagingVABuffer, gdata.interleaved.stagingVAbufferMemory);
-                vkMapMemory(iinstance.device, gdata.interleaved.stagingVAbufferMemory, 0, vaBufferSize, 0, &gdata.interleaved.mappedStagingVAPtr);
+                gdata.interleaved.staging = acquireStaging(vaBufferSize);
 
                 //create buffer for final vertex attributes buffer
-                createBuffer(vaBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gdata.interleaved.vaBuffer, gdata.interleaved.vaBufferMemory);
+                if (gdata.sharedBuffers) 
+                {
+                    //stride aligned so that the range can be addressed with a vertex offset
+                    gdata.interleaved.vaRange = allocateGeometryRange(isharedVertexBuffers, vaBufferSize, stride, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+                    gdata.interleaved.vaBuffer = isharedVertexBuffers[gdata.interleaved.vaRange.bufferIndex].buffer;
+                }
+                else 
+                {
+                    createBuffer(vaBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gdata.interleaved.vaBuffer, gdata.interleaved.vaBufferMemory);
+                }
                 break;
             }
 
@@ -2352,16 +3915,28 @@ RSresult VkRenderSystem::geometryDataCreate(RSgeometryDataID& outgdataID, uint32
                 {
                     RSvertexAttribute attrib = gdata.attributesInfo.attributes[i];
                     VkDeviceSize bufferSize = numVertices * attributesInfo.sizeOfAttrib(attrib);
+                    uint32_t attribidx = static_cast<uint32_t>(attrib);
+                    VkRSbuffer& deviceBuffer = gdata.separate.buffers[attribidx];
+                    if (gdata.dynamicBuffers) 
+                    {
+                        createBuffer(VkRSgeometryData::copyStride(bufferSize) * numCopies, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, dynamicProperties, deviceBuffer.buffer, deviceBuffer.memory);
+                        continue;
+                    }
                     
                     //create staging buffer.
-                    uint32_t attribidx = static_cast<uint32_t>(attrib);
-                    VkRSbuffer& stageBuffer = gdata.separate.stagingBuffers[attribidx];
-                    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stageBuffer.buffer, stageBuffer.memory);
-                    vkMapMemory(iinstance.device, stageBuffer.memory, 0, bufferSize, 0, &stageBuffer.mapped);
+                    gdata.separate.staging[attribidx] = acquireStaging(bufferSize);
 
                     //create the device buffer
-                    VkRSbuffer& deviceBuffer = gdata.separate.buffers[attribidx];
-                    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, deviceBuffer.buffer, deviceBuffer.memory);
+                    if (gdata.sharedBuffers) 
+                    {
+                        VkRSgeometryRange& range = gdata.separate.ranges[attribidx];
+                        range = allocateGeometryRange(isharedVertexBuffers, bufferSize, attributesInfo.sizeOfAttrib(attrib), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+                        deviceBuffer.buffer = isharedVertexBuffers[range.bufferIndex].buffer;
+                    }
+                    else 
+                    {
+                        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, deviceBuffer.buffer, deviceBuffer.memory);
+                    }
                 }
                 break;
             }
@@ -2370,11 +3945,23 @@ RSresult VkRenderSystem::geometryDataCreate(RSgeometryDataID& outgdataID, uint32
         //create buffer for indices
         if (numIndices) 
         {
-            VkDeviceSize indexBufferSize = numIndices * sizeof(uint32_t);
-            createBuffer(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, gdata.indices.stagingIndexBuffer, gdata.indices.stagingIndexBufferMemory);
-            vkMapMemory(iinstance.device, gdata.indices.stagingIndexBufferMemory, 0, indexBufferSize, 0, &gdata.indices.mappedIndexPtr);
-        
-            createBuffer(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gdata.indices.indicesBuffer, gdata.indices.indicesBufferMemory);
+            assert((indexType == RSindexType::itUint32 || numVertices <= 65536) && "16 bit indices cannot address all vertices");
+            VkDeviceSize indexBufferSize = numIndices * gdata.indexSize();
+            if (gdata.dynamicBuffers) 
+            {
+                createBuffer(VkRSgeometryData::copyStride(indexBufferSize) * numCopies, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, dynamicProperties, gdata.indices.indicesBuffer, gdata.indices.indicesBufferMemory);
+            }
+            else if (gdata.sharedBuffers) 
+            {
+                gdata.indices.staging = acquireStaging(indexBufferSize);
+                gdata.indices.indicesRange = allocateGeometryRange(isharedIndexBuffers, indexBufferSize, gdata.indexSize(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+                gdata.indices.indicesBuffer = isharedIndexBuffers[gdata.indices.indicesRange.bufferIndex].buffer;
+            }
+            else 
+            {
+                gdata.indices.staging = acquireStaging(indexBufferSize);
+                createBuffer(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gdata.indices.indicesBuffer, gdata.indices.indicesBufferMemory);
+            }
         }
 
         outgdataID.id = id;
@@ -2385,30 +3972,141 @@ RSresult VkRenderSystem::geometryDataCreate(RSgeometryDataID& outgdataID, uint32
     return RSresult::FAILURE;
 }
 
+RSresult VkRenderSystem::writeGeometryData(const RSgeometryDataID& gdataID, const VkRSgeometryData& gdata, VkRSstagingRange& staging, VkRSdirtyRanges& dirty, VkDeviceSize capacity, uint32_t offset, uint32_t sizeInBytes, const void* data)
+{
+    assert(static_cast<VkDeviceSize>(offset) + sizeInBytes <= capacity && "update exceeds the geometry data");
+    if (static_cast<VkDeviceSize>(offset) + sizeInBytes > capacity) 
+    {
+        return RSresult::FAILURE;
+    }
+
+    if (gdata.finalized) 
+    {
+        //the staging memory is gone, the bytes are kept until the next upload flush copies them into the device buffer
+        dirty.write(offset, data, sizeInBytes);
+        idirtyGeometryData.insert(gdataID);
+    }
+    else 
+    {
+        memcpy(static_cast<char*>(staging.mapped) + offset, data, sizeInBytes);
+    }
+
+    return RSresult::SUCCESS;
+}
+
+char* VkRenderSystem::acquireWriteCopy(const RSgeometryDataID& gdataID, VkRSgeometryData& gdata, const VkRSallocation& memory, VkDeviceSize copySize)
+{
+    if (gdata.writeCopy == VkRSgeometryData::NO_COPY) 
+    {
+        //frames that bound the copy when it was last current must be done with it before it is overwritten. With one copy
+        //more than frames in flight, those frames have left the flight even when the data is published every frame
+        const uint32_t copy = (gdata.currentCopy + 1) % VkRSgeometryData::NUM_COPIES;
+        waitForSubmission(gdata.copyReadSerials[copy]);
+
+        if (gdata.attributesInfo.usageHint == RSbufferUsageHint::buDynamic) 
+        {
+            //updates keep the rest of the data, so the copy starts out as the current one
+            const auto copyContents = [&gdata, copy](const VkRSallocation& bufferMemory, VkDeviceSize size)
+            {
+                char* mapped = static_cast<char*>(bufferMemory.mapped);
+                const VkDeviceSize stride = VkRSgeometryData::copyStride(size);
+                memcpy(mapped + copy * stride, mapped + gdata.currentCopy * stride, static_cast<size_t>(size));
+            };
+            if (gdata.attributesInfo.settings == RSvertexAttributeSettings::vasInterleaved) 
+            {
+                copyContents(gdata.interleaved.vaBufferMemory, gdata.numVertices * gdata.attributesInfo.sizeOfInterleavedAttrib());
+            }
+            else 
+            {
+                for (uint32_t i = 0; i < gdata.attributesInfo.numVertexAttribs; i++) 
+                {
+                    const RSvertexAttribute attrib = gdata.attributesInfo.attributes[i];
+                    copyContents(gdata.separate.buffers[static_cast<uint32_t>(attrib)].memory, gdata.numVertices * gdata.attributesInfo.sizeOfAttrib(attrib));
+                }
+            }
+            if (gdata.numIndices) 
+            {
+                copyContents(gdata.indices.indicesBufferMemory, gdata.numIndices * gdata.indexSize());
+            }
+        }
+
+        gdata.writeCopy = copy;
+        //published by the next upload flush
+        idirtyGeometryData.insert(gdataID);
+    }
+
+    return static_cast<char*>(memory.mapped) + gdata.writeCopy * VkRSgeometryData::copyStride(copySize);
+}
+
+RSresult VkRenderSystem::writeDynamicGeometryData(const RSgeometryDataID& gdataID, VkRSgeometryData& gdata, const VkRSallocation& memory, VkDeviceSize capacity, uint32_t offset, uint32_t sizeInBytes, const void* data)
+{
+    assert(static_cast<VkDeviceSize>(offset) + sizeInBytes <= capacity && "update exceeds the geometry data");
+    if (static_cast<VkDeviceSize>(offset) + sizeInBytes > capacity) 
+    {
+        return RSresult::FAILURE;
+    }
+
+    char* copy = acquireWriteCopy(gdataID, gdata, memory, capacity);
+    memcpy(copy + offset, data, sizeInBytes);
+    return RSresult::SUCCESS;
+}
+
+void VkRenderSystem::publishDynamicGeometryData(VkRSgeometryData& gdata)
+{
+    if (gdata.writeCopy == VkRSgeometryData::NO_COPY) 
+    {
+        return;
+    }
+
+    //frames submitted so far bound the current copy, collections recorded from now on bind the written one
+    gdata.copyReadSerials[gdata.currentCopy] = isubmitSerial;
+    gdata.currentCopy = gdata.writeCopy;
+    gdata.writeCopy = VkRSgeometryData::NO_COPY;
+}
+
+void VkRenderSystem::waitForSubmission(uint64_t serial)
+{
+    //a fence is only reset right before it is submitted again, so the pending fences up to serial cover every submission
+    std::vector<VkFence> fences;
+    for (const auto& iter : ipendingFences)
+    {
+        if (iter.second <= serial)
+        {
+            fences.push_back(iter.first);
+        }
+    }
+
+    if (!fences.empty())
+    {
+        vkWaitForFences(iinstance.device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX);
+        for (const VkFence fence : fences)
+        {
+            ipendingFences.erase(fence);
+        }
+    }
+}
+
 RSresult VkRenderSystem::geometryDataUpdateInterleavedVertices(const RSgeometryDataID& gdataID, uint32_t offset, uint32_t sizeInBytes, void* data) 
 {
     assert(gdataID.isValid() && "input geometry data ID is invalid");
 
     if (geometryDataAvailable(gdataID)) 
     {
-        VkRSgeometryData gdata = igeometryDataMap[gdataID];
+        VkRSgeometryData& gdata = igeometryDataMap[gdataID];
         assert(gdata.attributesInfo.settings == RSvertexAttributeSettings::vasInterleaved && "attributes are not interleaved");
         if (gdata.attributesInfo.settings != RSvertexAttributeSettings::vasInterleaved) 
         {
             return RSresult::FAILURE;
         }
 
-        if (offset != 0) 
+        //Debugging purposes-
+        //rsvd::VertexPC* vertices = static_cast<rsvd::VertexPC*>(gdata.interleaved.staging.mapped);
+        const VkDeviceSize capacity = gdata.numVertices * gdata.attributesInfo.sizeOfInterleavedAttrib();
+        if (gdata.dynamicBuffers) 
         {
-            throw std::runtime_error("Unsupported operation!");
+            return writeDynamicGeometryData(gdataID, gdata, gdata.interleaved.vaBufferMemory, capacity, offset, sizeInBytes, data);
         }
-        
-        //memcpy((char*)gdata.mappedStagingVAPtr + offset, data, sizeinBytes);
-        memcpy(gdata.interleaved.mappedStagingVAPtr, data, sizeInBytes);
-        //Debugging purposes-
-        //rsvd::VertexPC* vertices = static_cast<rsvd::VertexPC*>(gdata.interleaved.mappedStagingVAPtr);
-
-        return RSresult::SUCCESS;
+        return writeGeometryData(gdataID, gdata, gdata.interleaved.staging, gdata.interleaved.dirty, capacity, offset, sizeInBytes, data);
     }
     return RSresult::FAILURE;
 }
@@ -2419,7 +4117,7 @@ RSresult VkRenderSystem::geometryDataUpdateVertices(const RSgeometryDataID& gdat
 
     if (geometryDataAvailable(gdataID)) 
     {
-        VkRSgeometryData gdata = igeometryDataMap[gdataID];
+        VkRSgeometryData& gdata = igeometryDataMap[gdataID];
 
         assert(gdata.attributesInfo.settings == RSvertexAttributeSettings::vasSeparate && "attributes are not separate");
         if (gdata.attributesInfo.settings != RSvertexAttributeSettings::vasSeparate) 
@@ -2427,9 +4125,12 @@ RSresult VkRenderSystem::geometryDataUpdateVertices(const RSgeometryDataID& gdat
             return RSresult::FAILURE;
         }
         uint32_t attribIdx = static_cast<uint32_t>(attrib);
-        memcpy(gdata.separate.stagingBuffers[attribIdx].mapped, data, sizeInBytes);
-
-        return RSresult::SUCCESS;
+        const VkDeviceSize capacity = gdata.numVertices * gdata.attributesInfo.sizeOfAttrib(attrib);
+        if (gdata.dynamicBuffers) 
+        {
+            return writeDynamicGeometryData(gdataID, gdata, gdata.separate.buffers[attribIdx].memory, capacity, offset, sizeInBytes, data);
+        }
+        return writeGeometryData(gdataID, gdata, gdata.separate.staging[attribIdx], gdata.separate.dirty[attribIdx], capacity, offset, sizeInBytes, data);
     }
 
     return RSresult::FAILURE;
@@ -2441,38 +4142,154 @@ RSresult VkRenderSystem::geometryDataUpdateIndices(const RSgeometryDataID& gdata
 
     if (geometryDataAvailable(gdataID)) 
     {
-        VkRSgeometryData gdata = igeometryDataMap[gdataID];
-        memcpy(gdata.indices.mappedIndexPtr, data, sizeInBytes);
+        VkRSgeometryData& gdata = igeometryDataMap[gdataID];
         //For debugging purposes:
-        //uint32_t* indices = static_cast<uint32_t*>(gdata.indices.mappedIndexPtr);
-        return RSresult::SUCCESS;
+        //uint32_t* indices = static_cast<uint32_t*>(gdata.indices.staging.mapped);
+        const VkDeviceSize capacity = gdata.numIndices * gdata.indexSize();
+        if (gdata.dynamicBuffers) 
+        {
+            return writeDynamicGeometryData(gdataID, gdata, gdata.indices.indicesBufferMemory, capacity, offset, sizeInBytes, data);
+        }
+        return writeGeometryData(gdataID, gdata, gdata.indices.staging, gdata.indices.dirty, capacity, offset, sizeInBytes, data);
     }
     return RSresult::FAILURE;
 }
 
+void* VkRenderSystem::geometryDataMapInterleavedVertices(const RSgeometryDataID& gdataID) 
+{
+    assert(gdataID.isValid() && "input geometry data ID is invalid");
+
+    if (geometryDataAvailable(gdataID)) 
+    {
+        VkRSgeometryData& gdata = igeometryDataMap[gdataID];
+        assert(gdata.dynamicBuffers && "only dynamic and stream geometry data can be mapped");
+        assert(gdata.attributesInfo.settings == RSvertexAttributeSettings::vasInterleaved && "attributes are not interleaved");
+        if (!gdata.dynamicBuffers || gdata.attributesInfo.settings != RSvertexAttributeSettings::vasInterleaved) 
+        {
+            return nullptr;
+        }
+        return acquireWriteCopy(gdataID, gdata, gdata.interleaved.vaBufferMemory, gdata.numVertices * gdata.attributesInfo.sizeOfInterleavedAttrib());
+    }
+    return nullptr;
+}
+
+void* VkRenderSystem::geometryDataMapVertices(const RSgeometryDataID& gdataID, RSvertexAttribute attrib) 
+{
+    assert(gdataID.isValid() && "input geometry data ID is invalid");
+
+    if (geometryDataAvailable(gdataID)) 
+    {
+        VkRSgeometryData& gdata = igeometryDataMap[gdataID];
+        assert(gdata.dynamicBuffers && "only dynamic and stream geometry data can be mapped");
+        assert(gdata.attributesInfo.settings == RSvertexAttributeSettings::vasSeparate && "attributes are not separate");
+        if (!gdata.dynamicBuffers || gdata.attributesInfo.settings != RSvertexAttributeSettings::vasSeparate) 
+        {
+            return nullptr;
+        }
+        const VkRSallocation& memory = gdata.separate.buffers[static_cast<uint32_t>(attrib)].memory;
+        return acquireWriteCopy(gdataID, gdata, memory, gdata.numVertices * gdata.attributesInfo.sizeOfAttrib(attrib));
+    }
+    return nullptr;
+}
+
+void* VkRenderSystem::geometryDataMapIndices(const RSgeometryDataID& gdataID) 
+{
+    assert(gdataID.isValid() && "input geometry data ID is invalid");
+
+    if (geometryDataAvailable(gdataID)) 
+    {
+        VkRSgeometryData& gdata = igeometryDataMap[gdataID];
+        assert(gdata.dynamicBuffers && gdata.numIndices && "only indices of dynamic and stream geometry data can be mapped");
+        if (!gdata.dynamicBuffers || !gdata.numIndices) 
+        {
+            return nullptr;
+        }
+        return acquireWriteCopy(gdataID, gdata, gdata.indices.indicesBufferMemory, gdata.numIndices * gdata.indexSize());
+    }
+    return nullptr;
+}
+
+void VkRenderSystem::stageBufferUpdates(VkRSdirtyRanges& dirty, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+    for (auto& range : dirty.ranges) 
+    {
+        const VkDeviceSize size = range.second.size();
+        VkRSstagingRange staging = acquireStaging(size);
+        memcpy(staging.mapped, range.second.data(), static_cast<size_t>(size));
+
+        //acquiring staging memory may have flushed the batch, so the batch is picked afterwards
+        getUploadCommandBuffer();
+        VkRSbufferUpdate update;
+        update.srcBuffer = staging.buffer;
+        update.dstBuffer = dstBuffer;
+        update.region.srcOffset = staging.offset;
+        update.region.dstOffset = dstOffset + range.first;
+        update.region.size = size;
+        iuploadBatch.updates.push_back(update);
+        releaseStagingAfterUpload(staging);
+    }
+    dirty.ranges.clear();
+}
+
+void VkRenderSystem::stageGeometryDataUpdates()
+{
+    bool publishedDynamicData = false;
+    for (const RSgeometryDataID& gdataID : idirtyGeometryData) 
+    {
+        VkRSgeometryData& gdata = igeometryDataMap[gdataID];
+        if (gdata.dynamicBuffers) 
+        {
+            publishDynamicGeometryData(gdata);
+            publishedDynamicData = true;
+            continue;
+        }
+        stageBufferUpdates(gdata.interleaved.dirty, gdata.interleaved.vaBuffer, gdata.interleaved.vaRange.offset);
+        for (uint32_t i = 0; i < static_cast<uint32_t>(gdata.separate.dirty.size()); i++) 
+        {
+            stageBufferUpdates(gdata.separate.dirty[i], gdata.separate.buffers[i].buffer, gdata.separate.ranges[i].offset);
+        }
+        stageBufferUpdates(gdata.indices.dirty, gdata.indices.indicesBuffer, gdata.indices.indicesRange.offset);
+        gdata.uploadSerial = iuploadSerial;
+    }
+    idirtyGeometryData.clear();
+
+    if (publishedDynamicData) 
+    {
+        //recorded draws bind the previous copies
+        for (auto& iter : icollectionMap) 
+        {
+            if (iter.second.hasDynamicGeometry) 
+            {
+                iter.second.version++;
+            }
+        }
+    }
+}
+
 RSresult VkRenderSystem::geometryDataFinalize(const RSgeometryDataID& gdataID) 
 {
     assert(gdataID.isValid() && "input geometry data ID is invalid");
 
     if (geometryDataAvailable(gdataID)) 
     {
-        VkRSgeometryData gdata = igeometryDataMap[gdataID];
+        VkRSgeometryData& gdata = igeometryDataMap[gdataID];
+        assert(!gdata.finalized && "geometry data is already finalized");
+        if (gdata.dynamicBuffers) 
+        {
+            //written in place, the copy written so far is published by the next upload flush
+            gdata.finalized = true;
+            return RSresult::SUCCESS;
+        }
 
-        //unmap the host pointers
+        //record the copies into the current upload batch, the staging buffers are released once it completes
         switch (gdata.attributesInfo.settings) 
         {
             case RSvertexAttributeSettings::vasInterleaved: 
             {
-                vkUnmapMemory(iinstance.device, gdata.interleaved.stagingVAbufferMemory);
-                gdata.interleaved.mappedStagingVAPtr = nullptr;
-                
                 //copy to device buffer
-                VkDeviceSize vaBufferSize = gdata.numVertices * gdata.attributesInfo.sizeOfInterleavedAttrib();
-                copyBuffer(gdata.interleaved.stagingVABuffer, gdata.interleaved.vaBuffer, vaBufferSize);
-                
-                //destroy the staging buffers
-                vkDestroyBuffer(iinstance.device, gdata.interleaved.stagingVABuffer, nullptr);
-                vkFreeMemory(iinstance.device, gdata.interleaved.stagingVAbufferMemory, nullptr);
+                VkRSstagingRange& staging = gdata.interleaved.staging;
+                copyBuffer(staging.buffer, staging.offset, gdata.interleaved.vaBuffer, gdata.interleaved.vaRange.offset, staging.size);
+                releaseStagingAfterUpload(staging);
                 break;
             }
 
@@ -2481,17 +4298,12 @@ RSresult VkRenderSystem::geometryDataFinalize(const RSgeometryDataID& gdataID)
                 for(uint32_t i = 0; i < gdata.attributesInfo.numVertexAttribs; i++) {
                     RSvertexAttribute attrib = gdata.attributesInfo.attributes[i];
                     uint32_t attribIdx = static_cast<uint32_t>(attrib);
-                    VkRSbuffer& stagingBuffer = gdata.separate.stagingBuffers[attribIdx];
+                    VkRSstagingRange& staging = gdata.separate.staging[attribIdx];
                     VkRSbuffer& deviceBuffer = gdata.separate.buffers[attribIdx];
-                    stagingBuffer.mapped = nullptr;
 
                     //copy to device buffer
-                    VkDeviceSize bufferSize = gdata.numVertices * gdata.attributesInfo.sizeOfAttrib(attrib);
-                    copyBuffer(stagingBuffer.buffer, deviceBuffer.buffer, bufferSize);
-
-                    //destroy the staging buffers
-                    vkDestroyBuffer(iinstance.device, stagingBuffer.buffer, nullptr);
-                    vkFreeMemory(iinstance.device, stagingBuffer.memory, nullptr);
+                    copyBuffer(staging.buffer, staging.offset, deviceBuffer.buffer, gdata.separate.ranges[attribIdx].offset, staging.size);
+                    releaseStagingAfterUpload(staging);
                 }
                 break;
             }
@@ -2499,22 +4311,34 @@ RSresult VkRenderSystem::geometryDataFinalize(const RSgeometryDataID& gdataID)
 
         if (gdata.numIndices) 
         {
-            vkUnmapMemory(iinstance.device, gdata.indices.stagingIndexBufferMemory);
-            gdata.indices.mappedIndexPtr = nullptr;
             //copy to device buffer
-            VkDeviceSize indexBufferSize = gdata.numIndices * sizeof(uint32_t);
-            copyBuffer(gdata.indices.stagingIndexBuffer, gdata.indices.indicesBuffer, indexBufferSize);
-            //destroy the staging buffers
-            vkDestroyBuffer(iinstance.device, gdata.indices.stagingIndexBuffer, nullptr);
-            vkFreeMemory(iinstance.device, gdata.indices.stagingIndexBufferMemory, nullptr);
+            VkRSstagingRange& staging = gdata.indices.staging;
+            copyBuffer(staging.buffer, staging.offset, gdata.indices.indicesBuffer, gdata.indices.indicesRange.offset, staging.size);
+            releaseStagingAfterUpload(staging);
         }
 
+        gdata.finalized = true;
+        gdata.uploadSerial = iuploadSerial;
+
         return RSresult::SUCCESS;
     }
 
     return RSresult::FAILURE;
 }
 
+bool VkRenderSystem::geometryDataIsReady(const RSgeometryDataID& gdataID) 
+{
+    if (!geometryDataAvailable(gdataID)) 
+    {
+        return false;
+    }
+
+    pollUploads(false);
+    const VkRSgeometryData& gdata = igeometryDataMap[gdataID];
+    const bool hasPendingUpdates = idirtyGeometryData.find(gdataID) != idirtyGeometryData.end();
+    return gdata.finalized && !hasPendingUpdates && isUploadComplete(gdata.uploadSerial);
+}
+
 RSresult VkRenderSystem::geometryDataDispose(const RSgeometryDataID& gdataID) 
 {
     assert(gdataID.isValid() && "input geometry data ID is invalid");
@@ -2522,14 +4346,48 @@ RSresult VkRenderSystem::geometryDataDispose(const RSgeometryDataID& gdataID)
     if (geometryDataAvailable(gdataID)) 
     {
         VkRSgeometryData gdata = igeometryDataMap[gdataID];
-        vkDestroyBuffer(iinstance.device, gdata.interleaved.vaBuffer, nullptr);
-        vkFreeMemory(iinstance.device, gdata.interleaved.vaBufferMemory, nullptr);
-
-        if (gdata.numIndices) 
+        const VkDevice device = iinstance.device;
+        //copies still in flight write the device buffers, staging buffers of unfinalized data were never used
+        waitForUpload(gdata.uploadSerial);
+        idirtyGeometryData.erase(gdataID);
+        if (!gdata.finalized) 
         {
-            vkDestroyBuffer(iinstance.device, gdata.indices.indicesBuffer, nullptr);
-            vkFreeMemory(iinstance.device, gdata.indices.indicesBufferMemory, nullptr);
+            discardStaging(gdata.interleaved.staging);
+            for (VkRSstagingRange& staging : gdata.separate.staging) 
+            {
+                discardStaging(staging);
+            }
+            discardStaging(gdata.indices.staging);
         }
+        VkRSinterleavedGeomBuffers interleaved = gdata.interleaved;
+        VkRSseparateGeomBuffers separate = gdata.separate;
+        VkRSindicesBuffers indices = gdata.indices;
+        const bool sharedBuffers = gdata.sharedBuffers;
+        //frames in flight may still read the buffers
+        retire([this, device, interleaved, separate, indices, sharedBuffers]() mutable
+        {
+            if (sharedBuffers) 
+            {
+                //the ranges are handed back, the shared buffers live until the render system is disposed
+                freeGeometryRange(isharedVertexBuffers, interleaved.vaRange);
+                for (VkRSgeometryRange& range : separate.ranges) 
+                {
+                    freeGeometryRange(isharedVertexBuffers, range);
+                }
+                freeGeometryRange(isharedIndexBuffers, indices.indicesRange);
+                return;
+            }
+
+            vkDestroyBuffer(device, interleaved.vaBuffer, nullptr);
+            iallocator.free(interleaved.vaBufferMemory);
+            for (VkRSbuffer& buffer : separate.buffers) 
+            {
+                vkDestroyBuffer(device, buffer.buffer, nullptr);
+                iallocator.free(buffer.memory);
+            }
+            vkDestroyBuffer(device, indices.indicesBuffer, nullptr);
+            iallocator.free(indices.indicesBufferMemory);
+        });
         //delete the vertex attribute enums.
         delete[] gdata.attributesInfo.attributes;
         gdata.attributesInfo.attributes = nullptr;
@@ -2623,52 +4481,14 @@ RSresult VkRenderSystem::collectionCreate(RScollectionID& colID, const RScollect
 
 void VkRenderSystem::appearanceCreateDescriptorSetLayout(VkRSappearance& vkrsapp)
 {
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    VkResult res = VkResult::VK_ERROR_UNKNOWN;
+    //one layout per shader template, so that appearances of a template share their pipelines
     if(vkrsapp.appInfo.shaderTemplate == RSshaderTemplate::stVolumeSlice)
     {
-        VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-        samplerLayoutBinding.binding = 0;
-        samplerLayoutBinding.descriptorCount = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.pImmutableSamplers = nullptr;
-        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        VkDescriptorSetLayoutBinding uniformLayoutBinding{};
-        uniformLayoutBinding.binding = 1;
-        uniformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uniformLayoutBinding.descriptorCount = 1;
-        uniformLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        
-        std::array<VkDescriptorSetLayoutBinding, 2> layoutBindings {samplerLayoutBinding, uniformLayoutBinding};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
-        layoutInfo.pBindings = layoutBindings.data();
-
-        res = vkCreateDescriptorSetLayout(iinstance.device, &layoutInfo, nullptr, &vkrsapp.descriptorSetLayout);
-        if (res != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to create descriptor set layout!");
-        }
+        vkrsapp.descriptorSetLayout = VkRSfactory::getDescriptorLayout(DescriptorLayoutType::dltVolumeSlice);
     }
     else if(vkrsapp.appInfo.shaderTemplate == RSshaderTemplate::stSimpleTextured)
     {
-        VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-        samplerLayoutBinding.binding = 0;
-        samplerLayoutBinding.descriptorCount = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.pImmutableSamplers = nullptr;
-        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = 1;
-        layoutInfo.pBindings = &samplerLayoutBinding;
-
-        res = vkCreateDescriptorSetLayout(iinstance.device, &layoutInfo, nullptr, &vkrsapp.descriptorSetLayout);
-        if (res != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to create descriptor set layout!");
-        }
+        vkrsapp.descriptorSetLayout = VkRSfactory::getDescriptorLayout(DescriptorLayoutType::dltSimpleTextured);
     }
 }
 
@@ -2697,7 +4517,7 @@ void VkRenderSystem::appearanceCreateDescriptorSet(VkRSappearance& vkrsapp, cons
         for (size_t i = 0; i < VkRScontext::MAX_FRAMES_IN_FLIGHT; i++)
         {
             VkDescriptorImageInfo imageInfo{};
-            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            imageInfo.imageLayout = vkrstex.imageLayout;
             imageInfo.imageView = vkrstex.textureImageView;
             imageInfo.sampler = vkrstex.textureSampler;
 
@@ -2716,8 +4536,26 @@ void VkRenderSystem::appearanceCreateDescriptorSet(VkRSappearance& vkrsapp, cons
     
     if(vkrsapp.appInfo.shaderTemplate == RSshaderTemplate::stVolumeSlice)
     {
+        const auto& texIter = itextureMap.find(difftexID);
+        const bool bricked = texIter != itextureMap.end() && texIter->second.bricked;
         for(size_t i = 0; i < VkRScontext::MAX_FRAMES_IN_FLIGHT; i++)
         {
+            VkDescriptorBufferInfo pageTableInfo{};
+            pageTableInfo.buffer = bricked ? texIter->second.pageTableBuffer : iemptyPageTable;
+            pageTableInfo.offset = 0;
+            pageTableInfo.range = VK_WHOLE_SIZE;
+
+            VkWriteDescriptorSet pageTableWrite{};
+            pageTableWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            pageTableWrite.dstSet = vkrsapp.descriptorSets[i];
+            pageTableWrite.dstBinding = 2;
+            pageTableWrite.dstArrayElement = 0;
+            pageTableWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            pageTableWrite.descriptorCount = 1;
+            pageTableWrite.pBufferInfo = &pageTableInfo;
+
+            vkUpdateDescriptorSets(iinstance.device, 1, &pageTableWrite, 0, nullptr);
+
             VkDescriptorBufferInfo bufferInfo{};
             bufferInfo.buffer = vkrsapp.uniformBuffers[i];
             bufferInfo.offset = 0;
@@ -2750,7 +4588,7 @@ void VkRenderSystem::createVolumeSliceUniformBuffers(VkRSappearance& vkrsapp)
     for(size_t i = 0; i < VkRScontext::MAX_FRAMES_IN_FLIGHT; i++)
     {
         createBuffer(buffersize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vkrsapp.uniformBuffers[i], vkrsapp.uniformBuffersMemory[i]);
-        vkMapMemory(iinstance.device, vkrsapp.uniformBuffersMemory[i], 0, buffersize, 0, &vkrsapp.uniformBuffersMapped[i]);
+        vkrsapp.uniformBuffersMapped[i] = vkrsapp.uniformBuffersMemory[i].mapped;
     }
 }
 
@@ -2759,6 +4597,32 @@ void VkRenderSystem::updateVolumeSliceUniformBuffers(VkRSappearance& vkrsapp)
     VkRSvolumeSliceDescriptor ubo{};
     ubo.window = vkrsapp.appInfo.volumeSlice.window;
     ubo.rescale = vkrsapp.appInfo.volumeSlice.rescale;
+    ubo.lod.x = vkrsapp.appInfo.volumeSlice.lodBias;
+    
+    const auto& texIter = itextureMap.find(vkrsapp.appInfo.diffuseTexture);
+    if (texIter != itextureMap.end())
+    {
+        ubo.lod.y = static_cast<float>(texIter->second.texinfo.mipLevels - 1);
+    }
+    if (texIter != itextureMap.end() && texIter->second.streamed)
+    {
+        //streamed bricks are only ever added, so frames in flight reading the new bits sample regions that are already written
+        const RStextureInfo& texinfo = texIter->second.texinfo;
+        const VkRSvolumeStream& stream = texIter->second.stream;
+        const bool streaming = !stream.pending.empty() || !stream.inFlight.empty();
+        ubo.brickGrid = glm::uvec4(stream.gridSize, streaming ? 1 : 0);
+        ubo.brickScale = glm::vec4(glm::vec3(texinfo.width, texinfo.height, texinfo.depth) / glm::vec3(stream.brickSize), 1.0f);
+        ubo.residency = stream.residency;
+    }
+    else if (texIter != itextureMap.end() && texIter->second.bricked)
+    {
+        //bricked volumes page through the page table, which changes without touching the uniforms
+        const RStextureInfo& texinfo = texIter->second.texinfo;
+        const VkRSbrickCache& cache = texIter->second.brickCache;
+        ubo.brickGrid = glm::uvec4(cache.getGridSize(), 2);
+        ubo.brickScale = glm::vec4(glm::vec3(texinfo.width, texinfo.height, texinfo.depth) / static_cast<float>(cache.getBrickSize()), 1.0f);
+        ubo.atlasGrid = glm::uvec4(cache.getSlotGrid(), cache.getBrickSize());
+    }
     for(uint32_t i = 0; i < VkRScontext::MAX_FRAMES_IN_FLIGHT; i++)
     {
         memcpy(vkrsapp.uniformBuffersMapped[i], &ubo, sizeof(VkRSvolumeSliceDescriptor));
@@ -2805,6 +4669,13 @@ void VkRenderSystem::collectionInstanceHide(const RScollectionID& collID, const
         VkRScollection& coll = icollectionMap[collID];
         VkRScollectionInstance& vkrsinst = coll.instanceMap[instID];
         vkrsinst.hide = hide;
+        
+        const auto& slotIter = coll.drawSlots.find(instID);
+        if(slotIter != coll.drawSlots.end())
+        {
+            VkRSutils::setBit(coll.hiddenBits, slotIter->second, hide);
+            coll.version++;
+        }
     }
 }
 
@@ -2818,7 +4689,24 @@ RSresult VkRenderSystem::collectionInstanceDispose(const RScollectionID& collID,
         VkRScollection& coll = icollectionMap[collID];
         VkRScollectionInstance& vkrsinst = coll.instanceMap[instID];
 
+        const auto& cmdIter = coll.drawCommands.find(instID);
+        if (cmdIter != coll.drawCommands.end())
+        {
+            releaseGraphicsPipeline(cmdIter->second.pipeline);
+            coll.drawCommands.erase(cmdIter);
+        }
+        
+        //instance IDs are recycled, so views must forget this one
+        for (auto& viewIter : iviewMap)
+        {
+            const auto& hiddenIter = viewIter.second.hiddenInstances.find(collID);
+            if (hiddenIter != viewIter.second.hiddenInstances.end())
+            {
+                hiddenIter->second.erase(instID);
+            }
+        }
         coll.instanceMap.erase(instID);
+        buildDrawList(collID, coll);
         iinstanceIDpool.DestroyID(instID.id);
         return RSresult::SUCCESS;
     }
@@ -2877,6 +4765,25 @@ VkCompareOp VkRenderSystem::getDepthCompare(const RSdepthFunction depthFunc)
     return compareOp;
 }
 
+RSshaderTemplate VkRenderSystem::getInstancedShaderTemplate(const RSshaderTemplate shaderTemplate)
+{
+    switch (shaderTemplate)
+    {
+        case RSshaderTemplate::stPassthrough:
+        case RSshaderTemplate::stPassthroughInstanced:
+            return RSshaderTemplate::stPassthroughInstanced;
+            
+        case RSshaderTemplate::stSimpleLit:
+        case RSshaderTemplate::stSimpleLitInstanced:
+            return RSshaderTemplate::stSimpleLitInstanced;
+            
+        default:
+            break;
+    }
+    
+    return RSshaderTemplate::stMax;
+}
+
 RSresult VkRenderSystem::collectionFinalize(const RScollectionID& colID)
 {
     assert(colID.isValid() && "input collection ID is not valid");
@@ -2908,10 +4815,16 @@ RSresult VkRenderSystem::collectionFinalize(const RScollectionID& colID)
                     cmd.isIndexed = gdata.indices.indicesBuffer != VK_NULL_HANDLE;
                     cmd.numIndices = gdata.numIndices;
                     cmd.numVertices = gdata.numVertices;
+                    cmd.indexType = gdata.indexType == RSindexType::itUint16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+                    cmd.indicesOffset = static_cast<uint32_t>(gdata.indices.indicesRange.offset / gdata.indexSize());
                     cmd.attribSetting = gdata.attributesInfo.settings;
                     if (gdata.attributesInfo.settings == RSvertexAttributeSettings::vasInterleaved) 
                     {
+                        //interleaved ranges are stride aligned, so geometry data sharing a buffer also shares its binding
                         cmd.vertexBuffers = { gdata.interleaved.vaBuffer };
+                        cmd.vertexBufferOffsets = { 0 };
+                        cmd.vertexOffset = static_cast<uint32_t>(gdata.interleaved.vaRange.offset / gdata.attributesInfo.sizeOfInterleavedAttrib());
+                        cmd.vertexCopyStrides = { VkRSgeometryData::copyStride(gdata.numVertices * gdata.attributesInfo.sizeOfInterleavedAttrib()) };
                     } 
                     else
                     {
@@ -2921,8 +4834,17 @@ RSresult VkRenderSystem::collectionFinalize(const RScollectionID& colID)
                             uint32_t attribIdx = static_cast<uint32_t>(attrib);
                             assert(gdata.separate.buffers[attribIdx].buffer != VK_NULL_HANDLE && "specified vk buffer cannot be null");
                             cmd.vertexBuffers.push_back(gdata.separate.buffers[attribIdx].buffer);
+                            cmd.vertexBufferOffsets.push_back(gdata.separate.ranges[attribIdx].offset);
+                            cmd.vertexCopyStrides.push_back(VkRSgeometryData::copyStride(gdata.numVertices * gdata.attributesInfo.sizeOfAttrib(attrib)));
                         }
                     }
+                    cmd.dynamicGeometry = gdata.dynamicBuffers;
+                    //vfSnorm16 positions get w = 1, other formats keep the stored w
+                    const bool quantizedPositions = gdata.attributesInfo.getFormat(RSvertexAttribute::vaPosition) == RSvertexFormat::vfSnorm16;
+                    cmd.drawConstants.positionScale = glm::vec4(gdata.attributesInfo.positionScale, quantizedPositions ? 0.0f : 1.0f);
+                    cmd.drawConstants.positionBias = glm::vec4(gdata.attributesInfo.positionBias, quantizedPositions ? 1.0f : 0.0f);
+                    cmd.drawConstants.octahedralNormals = gdata.attributesInfo.getFormat(RSvertexAttribute::vaNormal) == RSvertexFormat::vfOctahedral ? 1 : 0;
+                    cmd.indicesCopyStride = VkRSgeometryData::copyStride(gdata.numIndices * gdata.indexSize());
                     cmd.primTopology = getPrimitiveType(geom.geomInfo.primType);
                     if (stateAvailable(collinst.instInfo.stateID))
                     {
@@ -2933,12 +4855,16 @@ RSresult VkRenderSystem::collectionFinalize(const RScollectionID& colID)
                     cmd.appID = collinst.instInfo.appID;
                     
                     cmd.spatialID = collinst.instInfo.spatialID.isValid() ? collinst.instInfo.spatialID : _identitySpatialID;
+                    cmd.instanceID = instID;
+                    cmd.gdataID = gdataID;
+                    cmd.stateID = collinst.instInfo.stateID;
 
-                    createGraphicsPipeline(collection, collinst, cmd);
+                    acquireGraphicsPipeline(collection, collinst, cmd);
 
                     collection.drawCommands[instID] = cmd;
                 }
             }
+            buildDrawList(colID, collection);
             collection.dirty = false;
         }
         return RSresult::SUCCESS;
@@ -2947,6 +4873,20 @@ RSresult VkRenderSystem::collectionFinalize(const RScollectionID& colID)
     return RSresult::FAILURE;
 }
 
+bool VkRenderSystem::collectionReady(const RScollectionID& colID)
+{
+    assert(colID.isValid() && "input collection ID is not valid");
+    
+    if (!collectionAvailable(colID))
+    {
+        return false;
+    }
+    
+    pollPipelineCompiles();
+    const VkRScollection& collection = icollectionMap[colID];
+    return !collection.dirty && !collection.pipelinesPending;
+}
+
 RSresult VkRenderSystem::collectionDispose(RScollectionID& colID) 
 {
     assert(colID.isValid() && "input collection ID is not valid");
@@ -2957,6 +4897,12 @@ RSresult VkRenderSystem::collectionDispose(RScollectionID& colID)
         //dispose the collection
         disposeCollection(collection);
         icollectionMap.erase(colID);
+        for (auto& viewIter : iviewMap)
+        {
+            viewIter.second.hiddenInstances.erase(colID);
+            viewIter.second.hiddenBits.erase(colID);
+            disposeCollectionCommands(viewIter.second, colID);
+        }
         
         icollIDpool.DestroyID(colID.id);
         colID.id = INVALID_ID;
@@ -2969,16 +4915,13 @@ RSresult VkRenderSystem::collectionDispose(RScollectionID& colID)
 
 void VkRenderSystem::disposeCollection(VkRScollection& collection) 
 {
-    const VkDevice& device = iinstance.device;
-
     //disposes vulkan constructs
-    for (size_t i = 0; i < collection.drawCommands.size(); i++) 
+    for (auto& iter : collection.drawCommands) 
     {
-        VkRSdrawCommand& drawcmd = collection.drawCommands[i];
+        VkRSdrawCommand& drawcmd = iter.second;
         
-        //dispose pipeline
-        vkDestroyPipeline(device, drawcmd.graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, drawcmd.pipelineLayout, nullptr);
+        //release the shared pipeline
+        releaseGraphicsPipeline(drawcmd.pipeline);
     }
     
     //dispose instances
@@ -2988,8 +4931,243 @@ void VkRenderSystem::disposeCollection(VkRScollection& collection)
         iinstanceIDpool.DestroyID(instID.id);
     }
     
+    disposeDrawBatches(collection);
+    
     collection.instanceMap.clear();
     collection.drawCommands.clear();
+    collection.drawList.clear();
+}
+
+void VkRenderSystem::buildDrawList(const RScollectionID& collID, VkRScollection& collection)
+{
+    collection.version++;
+    collection.drawList.clear();
+    collection.drawList.reserve(collection.drawCommands.size());
+    collection.hasDynamicGeometry = false;
+    for (const auto& iter : collection.drawCommands)
+    {
+        collection.drawList.push_back(iter.second);
+        collection.hasDynamicGeometry |= iter.second.dynamicGeometry;
+    }
+    
+    //sort by pipeline first to bind each one once, then so that draws sharing an appearance, geometry data and state end up
+    //adjacent. Pipelines are shared through the registry and those draws share the same key, so instances that can be merged
+    //into one instanced draw stay together within their pipeline's group.
+    std::sort(collection.drawList.begin(), collection.drawList.end(), [](const VkRSdrawCommand& a, const VkRSdrawCommand& b)
+    {
+        const uint64_t pipelineA = (uint64_t)a.pipeline;
+        const uint64_t pipelineB = (uint64_t)b.pipeline;
+        return std::tie(pipelineA, a.appID.id, a.gdataID.id, a.stateID.id, a.primTopology, a.instanceID.id) < std::tie(pipelineB, b.appID.id, b.gdataID.id, b.stateID.id, b.primTopology, b.instanceID.id);
+    });
+    
+    //slots changed, so rebuild the hidden bitsets of the collection and of every view hiding something in it
+    const size_t numWords = (collection.drawList.size() + 63) / 64;
+    collection.drawSlots.clear();
+    collection.hiddenBits.assign(numWords, 0);
+    for (uint32_t slot = 0; slot < static_cast<uint32_t>(collection.drawList.size()); slot++)
+    {
+        const RSinstanceID& instID = collection.drawList[slot].instanceID;
+        collection.drawSlots[instID] = slot;
+        if (collection.instanceMap[instID].hide)
+        {
+            VkRSutils::setBit(collection.hiddenBits, slot, true);
+        }
+    }
+    
+    buildDrawBatches(collection);
+    collection.pipelinesPending = !pipelinesReady(collection);
+    
+    for (auto& viewIter : iviewMap)
+    {
+        VkRSview& vkrsview = viewIter.second;
+        disposeCollectionCommands(vkrsview, collID);
+        const auto& hiddenIter = vkrsview.hiddenInstances.find(collID);
+        if (hiddenIter == vkrsview.hiddenInstances.end())
+        {
+            continue;
+        }
+        
+        std::vector<uint64_t>& viewBits = vkrsview.hiddenBits[collID];
+        viewBits.assign(numWords, 0);
+        for (const RSinstanceID& instID : hiddenIter->second)
+        {
+            const auto& slotIter = collection.drawSlots.find(instID);
+            if (slotIter != collection.drawSlots.end())
+            {
+                VkRSutils::setBit(viewBits, slotIter->second, true);
+            }
+        }
+    }
+}
+
+void VkRenderSystem::buildDrawBatches(VkRScollection& collection)
+{
+    //an instanced draw only pays off when it replaces at least this many draws
+    static const uint32_t MIN_INSTANCED_BATCH_SIZE = 2;
+    
+    disposeDrawBatches(collection);
+    
+    const uint32_t numDraws = static_cast<uint32_t>(collection.drawList.size());
+    uint32_t numInstances = 0;
+    uint32_t slot = 0;
+    while (slot < numDraws)
+    {
+        const VkRSdrawCommand& first = collection.drawList[slot];
+        uint32_t end = slot + 1;
+        while (end < numDraws)
+        {
+            const VkRSdrawCommand& next = collection.drawList[end];
+            if (next.appID != first.appID || next.gdataID != first.gdataID || next.stateID != first.stateID || next.primTopology != first.primTopology)
+            {
+                break;
+            }
+            end++;
+        }
+        
+        VkRSdrawBatch batch;
+        batch.firstSlot = slot;
+        batch.numSlots = end - slot;
+        
+        const RSshaderTemplate shaderTemplate = iappearanceMap[first.appID].appInfo.shaderTemplate;
+        if (batch.numSlots >= MIN_INSTANCED_BATCH_SIZE && getInstancedShaderTemplate(shaderTemplate) != RSshaderTemplate::stMax)
+        {
+            VkRSdrawCommand instancedcmd = first;
+            acquireGraphicsPipeline(collection, collection.instanceMap[first.instanceID], instancedcmd, true);
+            batch.instanced = true;
+            batch.firstInstance = numInstances;
+            batch.pipelineLayout = instancedcmd.pipelineLayout;
+            batch.pipeline = instancedcmd.pipeline;
+            numInstances += batch.numSlots;
+        }
+        
+        collection.batches.push_back(batch);
+        slot = end;
+    }
+    
+    //split the batches into chunks of roughly RECORD_CHUNK_DRAWS draws, each recorded into its own secondary command buffer
+    static const uint32_t RECORD_CHUNK_DRAWS = 512;
+    uint32_t chunkDraws = 0;
+    for (uint32_t b = 0; b < static_cast<uint32_t>(collection.batches.size()); b++)
+    {
+        if (collection.recordChunks.empty() || chunkDraws >= RECORD_CHUNK_DRAWS)
+        {
+            VkRSrecordChunk chunk;
+            chunk.firstBatch = b;
+            collection.recordChunks.push_back(chunk);
+            chunkDraws = 0;
+        }
+        collection.recordChunks.back().numBatches++;
+        chunkDraws += collection.batches[b].instanced ? 1 : collection.batches[b].numSlots;
+    }
+    
+    if (numInstances > 0)
+    {
+        createInstanceBuffers(collection, numInstances);
+    }
+}
+
+void VkRenderSystem::createInstanceBuffers(VkRScollection& collection, uint32_t numInstances)
+{
+    const VkDeviceSize buffersize = numInstances * sizeof(uint32_t);
+    const uint32_t MAX_FRAMES_IN_FLIGHT = VkRScontext::MAX_FRAMES_IN_FLIGHT;
+    
+    collection.instanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    collection.instanceSlotsWriters.assign(MAX_FRAMES_IN_FLIGHT, nullptr);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        VkRSbuffer& instbuffer = collection.instanceBuffers[i];
+        instbuffer.device = iinstance.device;
+        instbuffer.size = buffersize;
+        instbuffer.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        instbuffer.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        createBuffer(buffersize, instbuffer.usageFlags, instbuffer.memoryPropertyFlags, instbuffer.buffer, instbuffer.memory);
+        instbuffer.mapped = instbuffer.memory.mapped;
+    }
+    
+    VkDescriptorPoolSize storagePoolSize{};
+    storagePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    storagePoolSize.descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &storagePoolSize;
+    poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+
+    VkResult res = vkCreateDescriptorPool(iinstance.device, &poolInfo, nullptr, &collection.instanceDescriptorPool);
+    if (res != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor pool");
+    }
+    
+    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, VkRSfactory::getDescriptorLayout(DescriptorLayoutType::dltInstanceSlots));
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = collection.instanceDescriptorPool;
+    allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+    allocInfo.pSetLayouts = layouts.data();
+
+    collection.instanceDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    res = vkAllocateDescriptorSets(iinstance.device, &allocInfo, collection.instanceDescriptorSets.data());
+    if (res != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+    
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = collection.instanceBuffers[i].buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = buffersize;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = collection.instanceDescriptorSets[i];
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(iinstance.device, 1, &descriptorWrite, 0, nullptr);
+    }
+}
+
+void VkRenderSystem::disposeDrawBatches(VkRScollection& collection)
+{
+    for (const VkRSdrawBatch& batch : collection.batches)
+    {
+        if (batch.instanced)
+        {
+            releaseGraphicsPipeline(batch.pipeline);
+        }
+    }
+    collection.batches.clear();
+    collection.recordChunks.clear();
+    
+    const VkDevice device = iinstance.device;
+    std::vector<VkRSbuffer> instanceBuffers = collection.instanceBuffers;
+    const VkDescriptorPool instanceDescriptorPool = collection.instanceDescriptorPool;
+    if (!instanceBuffers.empty() || instanceDescriptorPool != VK_NULL_HANDLE)
+    {
+        retire([this, device, instanceBuffers, instanceDescriptorPool]() mutable
+        {
+            for (VkRSbuffer& instbuffer : instanceBuffers)
+            {
+                vkDestroyBuffer(device, instbuffer.buffer, nullptr);
+                iallocator.free(instbuffer.memory);
+            }
+            if (instanceDescriptorPool != VK_NULL_HANDLE)
+            {
+                vkDestroyDescriptorPool(device, instanceDescriptorPool, nullptr);
+            }
+        });
+    }
+    collection.instanceBuffers.clear();
+    collection.instanceSlotsWriters.clear();
+    collection.instanceDescriptorPool = VK_NULL_HANDLE;
+    collection.instanceDescriptorSets.clear();
 }
 
 bool VkRenderSystem::appearanceAvailable(const RSappearanceID& appID) const 
@@ -3045,16 +5223,17 @@ RSresult VkRenderSystem::appearanceDispose(const RSappearanceID& appID)
     if (appearanceAvailable(appID)) 
     {
         const VkRSappearance& vkrsapp = iappearanceMap[appID];
-        if(!vkrsapp.uniformBuffers.empty() && vkrsapp.uniformBuffersMemory.empty())
+        const VkDevice device = iinstance.device;
+        const std::vector<VkBuffer> uniformBuffers = vkrsapp.uniformBuffers;
+        std::vector<VkRSallocation> uniformBuffersMemory = vkrsapp.uniformBuffersMemory;
+        retire([this, device, uniformBuffers, uniformBuffersMemory]() mutable
         {
-            for (size_t i = 0; i < VkRScontext::MAX_FRAMES_IN_FLIGHT; i++)
+            for (size_t i = 0; i < uniformBuffers.size(); i++)
             {
-                vkDestroyBuffer(iinstance.device, vkrsapp.uniformBuffers[i], nullptr);
-                vkFreeMemory(iinstance.device, vkrsapp.uniformBuffersMemory[i], nullptr);
+                vkDestroyBuffer(device, uniformBuffers[i], nullptr);
+                iallocator.free(uniformBuffersMemory[i]);
             }
-        }
-
-        vkDestroyDescriptorSetLayout(iinstance.device, vkrsapp.descriptorSetLayout, nullptr);
+        });
         
         iappearanceMap.erase(appID);
         
@@ -3084,6 +5263,18 @@ RSresult VkRenderSystem::spatialCreate(RSspatialID& outSplID, const RSspatial& s
 
         outSplID.id = id;
         ispatialMap[outSplID] = vkrsspatial;
+        
+        if (id >= ispatialStore.capacity)
+        {
+            //growing rebinds the store in every view, so wait for frames still reading the old buffers
+            waitForInFlightFrames();
+            const uint32_t newCapacity = ispatialStore.capacity * 2 > id ? ispatialStore.capacity * 2 : id + 1;
+            createSpatialStore(newCapacity);
+        }
+        else
+        {
+            markSpatialDirty(id);
+        }
 
         return RSresult::SUCCESS;
     }
@@ -3096,6 +5287,7 @@ bool VkRenderSystem::spatialSetData(RSspatialID& spatialID, const RSspatial& spa
     if(spatialID.isValid())
     {
         ispatialMap[spatialID].spatial = spatial;
+        markSpatialDirty(spatialID.id);
         
         return true;
     }
@@ -3117,6 +5309,86 @@ RSresult VkRenderSystem::spatialDispose(const RSspatialID& spatialID)
     return RSresult::FAILURE;
 }
 
+void VkRenderSystem::createSpatialStore(uint32_t capacity)
+{
+    disposeSpatialStore();
+    
+    const uint32_t MAX_FRAMES_IN_FLIGHT = VkRScontext::MAX_FRAMES_IN_FLIGHT;
+    const VkDeviceSize buffersize = capacity * sizeof(RSspatial);
+    ispatialStore.capacity = capacity;
+    ispatialStore.buffers.resize(MAX_FRAMES_IN_FLIGHT);
+    ispatialStore.dirtySlots.assign(MAX_FRAMES_IN_FLIGHT, {});
+    ispatialStore.dirtyBits.assign(MAX_FRAMES_IN_FLIGHT, std::vector<uint64_t>((capacity + 63) / 64, 0));
+    
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        VkRSbuffer& splbuffer = ispatialStore.buffers[i];
+        splbuffer.device = iinstance.device;
+        splbuffer.size = buffersize;
+        splbuffer.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        splbuffer.memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        createBuffer(buffersize, splbuffer.usageFlags, splbuffer.memoryPropertyFlags, splbuffer.buffer, splbuffer.memory);
+        splbuffer.mapped = splbuffer.memory.mapped;
+        
+        //a fresh store receives every live spatial at once
+        RSspatial* mappedSpatials = static_cast<RSspatial*>(splbuffer.mapped);
+        for (const auto& iter : ispatialMap)
+        {
+            mappedSpatials[iter.first.id] = iter.second.spatial;
+        }
+    }
+    
+    for (auto& iter : iviewMap)
+    {
+        writeViewSpatialDescriptors(iter.second);
+    }
+}
+
+void VkRenderSystem::disposeSpatialStore()
+{
+    for (VkRSbuffer& splbuffer : ispatialStore.buffers)
+    {
+        vkDestroyBuffer(iinstance.device, splbuffer.buffer, nullptr);
+        iallocator.free(splbuffer.memory);
+    }
+    ispatialStore.buffers.clear();
+    ispatialStore.dirtySlots.clear();
+    ispatialStore.dirtyBits.clear();
+    ispatialStore.capacity = 0;
+}
+
+void VkRenderSystem::markSpatialDirty(uint32_t slot)
+{
+    assert(slot < ispatialStore.capacity && "spatial slot is out of the store range");
+    const uint64_t mask = uint64_t(1) << (slot % 64);
+    for (size_t i = 0; i < ispatialStore.dirtySlots.size(); i++)
+    {
+        uint64_t& word = ispatialStore.dirtyBits[i][slot / 64];
+        if ((word & mask) == 0)
+        {
+            word |= mask;
+            ispatialStore.dirtySlots[i].push_back(slot);
+        }
+    }
+}
+
+void VkRenderSystem::flushSpatials(uint32_t currentFrame)
+{
+    std::vector<uint32_t>& dirtySlots = ispatialStore.dirtySlots[currentFrame];
+    std::vector<uint64_t>& dirtyBits = ispatialStore.dirtyBits[currentFrame];
+    RSspatial* mappedSpatials = static_cast<RSspatial*>(ispatialStore.buffers[currentFrame].mapped);
+    for (const uint32_t slot : dirtySlots)
+    {
+        const auto& iter = ispatialMap.find(RSspatialID(slot));
+        if (iter != ispatialMap.end())
+        {
+            mappedSpatials[slot] = iter->second.spatial;
+        }
+        dirtyBits[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    }
+    dirtySlots.clear();
+}
+
 bool VkRenderSystem::textureAvailable(const RStextureID& texID) 
 {
     return texID.isValid() && itextureMap.find(texID) != itextureMap.end();
@@ -3144,7 +5416,7 @@ RSresult VkRenderSystem::textureCreate(RStextureID& outTexID, const char* absfil
     return RSresult::FAILURE;
 }
 
-RSresult VkRenderSystem::texture3dCreate(RStextureID& outTexID, const RStextureInfo& texInfo)
+RSresult VkRenderSystem::texture3dCreate(RStextureID& outTexID, const RStextureInfo& texInfo, bool streamed, RSmipReduction mipReduction)
 {
     assert(texInfo.textureType == RStextureType::ttTexture3D && "invalid texture type");
     assert(texInfo.texelFormat != RStextureFormat::vsInvalid && "unset texture format");
@@ -3155,7 +5427,47 @@ RSresult VkRenderSystem::texture3dCreate(RStextureID& outTexID, const RStextureI
     {
         VkRStexture vkrstex;
         vkrstex.texinfo = texInfo;
-        createTextureImage(vkrstex);
+        if (streamed)
+        {
+            //bricks are streamed into the finest level only
+            assert(texInfo.mipLevels == 1 && mipReduction == RSmipReduction::mrNone && "streamed volumes have no mip pyramid");
+            createStreamedTextureImage(vkrstex);
+        }
+        else if (mipReduction != RSmipReduction::mrNone && texInfo.mipLevels == 1)
+        {
+            //the pyramid is staged by createTextureImage, the texture keeps the caller's texels like any other
+            vkrstex.texinfo = TextureLoader::create3Dpyramid(texInfo, mipReduction);
+            createTextureImage(vkrstex);
+            delete[] static_cast<uint8_t*>(vkrstex.texinfo.texels);
+            vkrstex.texinfo.texels = texInfo.texels;
+        }
+        else
+        {
+            createTextureImage(vkrstex);
+        }
+        createTextureImageView(vkrstex);
+        createTextureSampler(vkrstex);
+        outTexID.id = id;
+        itextureMap[outTexID] = vkrstex;
+
+        return RSresult::SUCCESS;
+    }
+    
+    return RSresult::FAILURE;
+}
+
+RSresult VkRenderSystem::texture3dCreateBricked(RStextureID& outTexID, const RStextureInfo& texInfo, const RSbrickedVolumeInfo& brickInfo)
+{
+    assert(texInfo.textureType == RStextureType::ttTexture3D && "invalid texture type");
+    assert(texInfo.texelFormat != RStextureFormat::vsInvalid && "unset texture format");
+    RSuint id;
+    bool success = itextureIDpool.CreateID(id);
+    assert(success && "failed to create a texture ID");
+    if (success) 
+    {
+        VkRStexture vkrstex;
+        vkrstex.texinfo = texInfo;
+        createBrickedTextureImage(vkrstex, brickInfo);
         createTextureImageView(vkrstex);
         createTextureSampler(vkrstex);
         outTexID.id = id;
@@ -3188,6 +5500,90 @@ RSresult VkRenderSystem::textureCreateFromMemory(RStextureID& outTexID, unsigned
     return RSresult::FAILURE;
 }
 
+bool VkRenderSystem::textureIsReady(const RStextureID& texID) 
+{
+    if (!textureAvailable(texID)) 
+    {
+        return false;
+    }
+
+    pollUploads(false);
+    const VkRStexture& vkrstex = itextureMap[texID];
+    if (vkrstex.bricked)
+    {
+        //ready once the bricks the slices intersect are in the atlas
+        std::vector<uint32_t> sliceBricks;
+        vkrstex.brickCache.getSliceBricks(vkrstex.stream.focus, sliceBricks);
+        for (uint32_t brick : sliceBricks)
+        {
+            if (!vkrstex.brickCache.isResident(brick))
+            {
+                return false;
+            }
+        }
+    }
+    return isUploadComplete(vkrstex.uploadSerial) && vkrstex.stream.pending.empty();
+}
+
+void VkRenderSystem::textureSetStreamFocus(const RStextureID& texID, const glm::uvec3& focus)
+{
+    assert(texID.isValid() && "input texture ID is invalid");
+    
+    if (textureAvailable(texID) && (itextureMap[texID].streamed || itextureMap[texID].bricked))
+    {
+        VkRStexture& vkrstex = itextureMap[texID];
+        const glm::uvec3 dimensions(vkrstex.texinfo.width, vkrstex.texinfo.height, vkrstex.texinfo.depth);
+        vkrstex.stream.focus = glm::min(focus, dimensions - 1u);
+        vkrstex.stream.sortPending(dimensions);
+    }
+}
+
+bool VkRenderSystem::textureIsRegionResident(const RStextureID& texID, const RSvolumeChunk& region)
+{
+    if (!textureAvailable(texID)) 
+    {
+        return false;
+    }
+    
+    pollUploads(false);
+    VkRStexture& vkrstex = itextureMap[texID];
+    if (!vkrstex.streamed && !vkrstex.bricked)
+    {
+        return isUploadComplete(vkrstex.uploadSerial);
+    }
+    
+    //bricks of a bricked volume are resident once the batches up to the latest one placing a brick completed
+    if (vkrstex.streamed)
+    {
+        updateStreamResidency(texID, vkrstex);
+    }
+    else if (!isUploadComplete(vkrstex.uploadSerial))
+    {
+        return false;
+    }
+    const VkRSvolumeStream& stream = vkrstex.stream;
+    const VkRSbrickCache& cache = vkrstex.brickCache;
+    const glm::uvec3 brickSize = vkrstex.bricked ? glm::uvec3(cache.getBrickSize()) : stream.brickSize;
+    const glm::uvec3 gridSize = vkrstex.bricked ? cache.getGridSize() : stream.gridSize;
+    const glm::uvec3 first = glm::uvec3(region.xoffset, region.yoffset, region.zoffset) / brickSize;
+    const glm::uvec3 last = glm::min((glm::uvec3(region.xoffset, region.yoffset, region.zoffset) + glm::uvec3(region.xcount, region.ycount, region.zcount) - 1u) / brickSize, gridSize - 1u);
+    for (uint32_t z = first.z; z <= last.z; z++)
+    {
+        for (uint32_t y = first.y; y <= last.y; y++)
+        {
+            for (uint32_t x = first.x; x <= last.x; x++)
+            {
+                const uint32_t brick = x + gridSize.x * (y + gridSize.y * z);
+                if (vkrstex.bricked ? !cache.isResident(brick) : !stream.isResident(brick))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 RSresult VkRenderSystem::textureDispose(const RStextureID& texID) 
 {
     assert(texID.isValid() && "input texture ID is invalid");
@@ -3196,11 +5592,27 @@ RSresult VkRenderSystem::textureDispose(const RStextureID& texID)
     {
         VkRStexture& vkrstex = itextureMap[texID];
         vkrstex.texinfo.dispose();
+        waitForUpload(vkrstex.uploadSerial);
         
-        vkDestroyImage(iinstance.device, vkrstex.textureImage, nullptr);
-        vkFreeMemory(iinstance.device, vkrstex.textureImageMemory, nullptr);
-        vkDestroySampler(iinstance.device, vkrstex.textureSampler, nullptr);
-        vkDestroyImageView(iinstance.device, vkrstex.textureImageView, nullptr);
+        const VkDevice device = iinstance.device;
+        const VkImage textureImage = vkrstex.textureImage;
+        VkRSallocation textureImageMemory = vkrstex.textureImageMemory;
+        const VkSampler textureSampler = vkrstex.textureSampler;
+        const VkImageView textureImageView = vkrstex.textureImageView;
+        const VkBuffer pageTableBuffer = vkrstex.pageTableBuffer;
+        VkRSallocation pageTableMemory = vkrstex.pageTableMemory;
+        retire([this, device, textureImage, textureImageMemory, textureSampler, textureImageView, pageTableBuffer, pageTableMemory]() mutable
+        {
+            vkDestroyImage(device, textureImage, nullptr);
+            iallocator.free(textureImageMemory);
+            vkDestroySampler(device, textureSampler, nullptr);
+            vkDestroyImageView(device, textureImageView, nullptr);
+            if (pageTableBuffer != VK_NULL_HANDLE)
+            {
+                vkDestroyBuffer(device, pageTableBuffer, nullptr);
+                iallocator.free(pageTableMemory);
+            }
+        });
 
         itextureMap.erase(texID);
 
@@ -28,6 +28,14 @@ std::string getShaderStr(const RSshaderTemplate shaderTemplate) {
             shaderStr = "lines";
             break;
             
+        case RSshaderTemplate::stPassthroughInstanced:
+            shaderStr = "passthroughInstanced";
+            break;
+            
+        case RSshaderTemplate::stSimpleLitInstanced:
+            shaderStr = "simpleLitInstanced";
+            break;
+            
         default:
             break;
     }
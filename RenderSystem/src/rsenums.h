@@ -2,7 +2,7 @@
 #include <string>
 
 /**
-* @brief describes what vertex attributes are being used. 
+* @brief describes what vertex attributes are being used. With the default vfFloat format
 * vaPosition should always use glm::vec4 where w is reserved
 * vaNormal should always use glm::vec4 where w is reserved
 * vaColor should always use glm::vec4
@@ -25,6 +25,38 @@ enum RSvertexAttributeSettings
     vasSeparate
 };
 
+/**
+ * @brief Describes how a vertex attribute is stored in its buffer. Every component of a vec4 attribute is stored, vaTexCoord
+ * stores two.
+ */
+enum RSvertexFormat
+{
+    vfFloat, //32 bit floats, any attribute
+    vfHalf, //16 bit floats, any attribute
+    vfSnorm16, //16 bit signed normalized integers, vaPosition dequantized with the position scale and bias, or vaNormal
+    vfOctahedral, //vaNormal only: two 16 bit signed normalized integers of an octahedral encoding
+    vfUnorm8 //vaColor only: 8 bit unsigned normalized integers
+};
+
+/**
+ * @brief Describes the integer type of the indices of geometry data. Indices are kept in this type on the device.
+ */
+enum RSindexType
+{
+    itUint16, //enough for geometry data with fewer than 65536 vertices, halves the index memory
+    itUint32
+};
+
+/**
+ * @brief Describes how often geometry data changes once finalized, which decides where it is placed.
+ */
+enum RSbufferUsageHint
+{
+    buStatic, //written once, uploaded to device local memory
+    buDynamic, //updated now and then in place, host visible with a copy per frame in flight. Updates keep the rest of the data.
+    buStream //rewritten every frame through the mapped pointers, host visible with a copy per frame in flight
+};
+
 /**
  * @brief Describes the geometry primitive topology
  */
@@ -50,6 +82,8 @@ enum RSshaderTemplate
     stSimpleTextured,
     stVolumeSlice,
     stLines,
+    stPassthroughInstanced, //instanced variant of stPassthrough, picked by collectionFinalize for merged instances
+    stSimpleLitInstanced, //instanced variant of stSimpleLit, picked by collectionFinalize for merged instances
     stMax
 };
 
@@ -75,6 +109,17 @@ enum RStextureFormat
     vsInvalid
 };
 
+/**
+ * @brief Describes how a 2x2x2 block of voxels is reduced to one voxel of the next coarser level of a 3D mip pyramid.
+ */
+enum RSmipReduction
+{
+    mrNone,
+    mrBox, //the average of the block
+    mrMax, //the maximum of the block, so thin dense structures like vessels survive while thin hollow ones fade
+    mrInvalid
+};
+
 /**
  * @brief Describes the type of the texture worked on.
  */
@@ -102,6 +147,9 @@ enum RSdepthFunction
 enum DescriptorLayoutType
 {
     dltViewDefault,
+    dltInstanceSlots,
+    dltSimpleTextured,
+    dltVolumeSlice,
     dltInvalid
 };
 
@@ -0,0 +1,80 @@
+#version 450
+
+
+layout(set = 0, binding = 0) uniform View {
+    mat4 viewMat;
+    mat4 projMat;
+    vec4 lightPos;
+} view;
+
+struct Spatial {
+  mat4 modelMat;
+  mat4 modelInvMat;
+  mat4 textureMat;
+};
+
+//spatials of every instance, owned by the render system and indexed by spatial slot
+layout(std430, set = 0, binding = 1) readonly buffer Spatials {
+  Spatial spatials[];
+} spatialStore;
+
+//per draw constants: how the vertex attributes of the geometry data are encoded
+layout(push_constant) uniform DrawConstants {
+  vec4 positionScale; //quantized positions are dequantized as position * scale + bias
+  vec4 positionBias;
+  uint slot;
+  uint octahedralNormals;
+} draw;
+
+//spatial slots of the visible instances merged into this draw, indexed by gl_InstanceIndex
+layout(std430, set = 1, binding = 0) readonly buffer InstanceSlots {
+  uint slots[];
+} instances;
+
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec4 inNormal;
+layout(location = 2) in vec4 inColor;
+layout(location = 3) in vec2 inTexCoord;
+
+struct FragOut {
+    vec4 color;
+    vec3 normal;
+    vec2 texcoord;
+    vec3 viewDir;
+    vec3 lightDir;
+};
+
+layout(location = 0) out FragOut fragout;
+
+vec4 decodePosition(vec4 position) {
+  return position * draw.positionScale + draw.positionBias;
+}
+
+vec3 decodeNormal(vec4 normal) {
+  if (draw.octahedralNormals == 0) {
+    return normal.xyz;
+  }
+  //the lower hemisphere of the octahedron is folded over the diagonals
+  vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(n);
+}
+
+void main() {
+    vec4 position = decodePosition(inPosition);
+    vec3 normal = decodeNormal(inNormal);
+    Spatial spatial = spatialStore.spatials[instances.slots[gl_InstanceIndex]];
+    gl_Position = view.projMat * view.viewMat * spatial.modelMat * position;
+    fragout.color = inColor;
+    fragout.normal = normal;
+    fragout.texcoord = inTexCoord;
+    
+    vec4 eyepos = view.viewMat * position;
+    fragout.normal = mat3(view.viewMat) * normal;
+    vec3 lightPos = mat3(view.viewMat) * view.lightPos.xyz;
+    fragout.lightDir = lightPos - eyepos.xyz;
+    fragout.viewDir = -eyepos.xyz;
+}
+
@@ -7,11 +7,24 @@ layout(set = 0, binding = 0) uniform View {
     vec4 lightPos;
 } view;
 
-layout(push_constant) uniform Spatial {
-    mat4 modelMat;
-    mat4 modelInvMat;
-    mat4 textureMat;
-} spatial;
+struct Spatial {
+  mat4 modelMat;
+  mat4 modelInvMat;
+  mat4 textureMat;
+};
+
+//spatials of every instance, owned by the render system and indexed by spatial slot
+layout(std430, set = 0, binding = 1) readonly buffer Spatials {
+  Spatial spatials[];
+} spatialStore;
+
+//per draw constants: the spatial slot and how the vertex attributes of the geometry data are encoded
+layout(push_constant) uniform DrawConstants {
+  vec4 positionScale; //quantized positions are dequantized as position * scale + bias
+  vec4 positionBias;
+  uint slot;
+  uint octahedralNormals;
+} draw;
 
 layout(location = 0) in vec4 inPosition;
 layout(location = 1) in vec4 inNormal;
@@ -20,9 +33,15 @@ layout(location = 3) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragTexCoord;
 
+vec4 decodePosition(vec4 position) {
+  return position * draw.positionScale + draw.positionBias;
+}
+
 void main() {
-    gl_Position = view.projMat * view.viewMat * spatial.modelMat * inPosition;
-    vec4 volumeUVW = spatial.textureMat * inPosition;
+    vec4 position = decodePosition(inPosition);
+    Spatial spatial = spatialStore.spatials[draw.slot];
+    gl_Position = view.projMat * view.viewMat * spatial.modelMat * position;
+    vec4 volumeUVW = spatial.textureMat * position;
     fragTexCoord = volumeUVW.xyz;
 }
 
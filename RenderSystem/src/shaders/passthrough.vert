@@ -6,11 +6,24 @@ layout(set = 0, binding = 0) uniform View {
     mat4 projMat;
 } view;
 
-layout(push_constant) uniform Spatial {
+struct Spatial {
   mat4 modelMat;
   mat4 modelInvMat;
   mat4 textureMat;
-} spatial;
+};
+
+//spatials of every instance, owned by the render system and indexed by spatial slot
+layout(std430, set = 0, binding = 1) readonly buffer Spatials {
+  Spatial spatials[];
+} spatialStore;
+
+//per draw constants: the spatial slot and how the vertex attributes of the geometry data are encoded
+layout(push_constant) uniform DrawConstants {
+  vec4 positionScale; //quantized positions are dequantized as position * scale + bias
+  vec4 positionBias;
+  uint slot;
+  uint octahedralNormals;
+} draw;
 
 layout(location = 0) in vec4 inPosition;
 layout(location = 1) in vec4 inNormal;
@@ -25,14 +38,33 @@ struct FragDataOut {
 
 layout(location = 0) out FragDataOut fragout;
 
+vec4 decodePosition(vec4 position) {
+  return position * draw.positionScale + draw.positionBias;
+}
+
+vec3 decodeNormal(vec4 normal) {
+  if (draw.octahedralNormals == 0) {
+    return normal.xyz;
+  }
+  //the lower hemisphere of the octahedron is folded over the diagonals
+  vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(n);
+}
+
 void main() {
-    gl_Position = view.projMat * view.viewMat * spatial.modelMat * inPosition;
-    vec3 normal3 = (inNormal.xyz * 0.5f) + 0.5f;
+    vec4 position = decodePosition(inPosition);
+    vec3 normal = decodeNormal(inNormal);
+    Spatial spatial = spatialStore.spatials[draw.slot];
+    gl_Position = view.projMat * view.viewMat * spatial.modelMat * position;
+    vec3 normal3 = (normal * 0.5f) + 0.5f;
     normal3 = normalize(normal3);
     vec4 normalColor = vec4(normal3.xyz, 1.0f);
     fragout.color = normalColor;
     //fragout.color = vec4(inTexCoord.xy, 0.5, 1.0f);
-    fragout.normal = inNormal;
+    fragout.normal = vec4(normal, 0.0);
     fragout.texCoord = inTexCoord;
 
     gl_PointSize = 10.0f;
@@ -9,10 +9,66 @@ layout(set = 1, binding = 1) uniform VolumeSlice
 {
     vec2 window; //window[0] is window width and window[1] is window height
     vec2 rescale; //rescale[0] is m and rescale[1] is b
+    uvec4 brickGrid; //bricks per axis, w is 1 while a streamed volume streams in and 2 for a bricked volume
+    vec4 brickScale; //texture coordinates to brick coordinates
+    uvec4 residency[8]; //a bit per brick, set once the brick is uploaded
+    uvec4 atlasGrid; //slots per axis of the brick pool atlas of a bricked volume, w is the brick size
+    vec4 lod; //x is the bias added to the level picked from the voxel density, y is the coarsest level
 } volumeSlice;
+layout(std430, set = 1, binding = 2) readonly buffer PageTable
+{
+    uint entries[]; //per brick of a bricked volume, its atlas slot + 1 or 0 while it is not resident
+} pageTable;
 
 layout(location = 0) out vec4 outColor;
 
+bool isResident(vec3 texCoord)
+{
+    if(volumeSlice.brickGrid.w != 1)
+    {
+        return true;
+    }
+    
+    uvec3 brick = min(uvec3(texCoord * volumeSlice.brickScale.xyz), volumeSlice.brickGrid.xyz - 1);
+    uint index = brick.x + volumeSlice.brickGrid.x * (brick.y + volumeSlice.brickGrid.y * brick.z);
+    return (volumeSlice.residency[index / 128][(index / 32) % 4] & (1u << (index % 32))) != 0;
+}
+
+bool fetchBrick(vec3 texCoord, out uint smple)
+{
+    smple = 0;
+    const uint brickSize = volumeSlice.atlasGrid.w;
+    const uvec3 dimensions = uvec3(volumeSlice.brickScale.xyz * float(brickSize) + 0.5f);
+    const uvec3 voxel = min(uvec3(texCoord * vec3(dimensions)), dimensions - 1);
+    const uvec3 brick = voxel / brickSize;
+    const uint entry = pageTable.entries[brick.x + volumeSlice.brickGrid.x * (brick.y + volumeSlice.brickGrid.y * brick.z)];
+    if(entry == 0)
+    {
+        return false;
+    }
+    
+    const uint slot = entry - 1;
+    const uvec3 atlasGrid = volumeSlice.atlasGrid.xyz;
+    const uvec3 slotCoord = uvec3(slot % atlasGrid.x, (slot / atlasGrid.x) % atlasGrid.y, slot / (atlasGrid.x * atlasGrid.y));
+    smple = texelFetch(texSampler, ivec3(slotCoord * brickSize + voxel % brickSize), 0).r;
+    return true;
+}
+
+bool fetchVoxel(vec3 texCoord, float level, out uint smple)
+{
+    if(volumeSlice.brickGrid.w == 2)
+    {
+        return fetchBrick(texCoord, smple);
+    }
+    
+    smple = 0;
+    if(!isResident(texCoord))
+    {
+        return false;
+    }
+    smple = textureLod(texSampler, texCoord, level).r;
+    return true;
+}
 
 void main()
 {
@@ -20,6 +76,8 @@ void main()
     const float windowCenter = volumeSlice.window[1];
     const float m = volumeSlice.rescale[0];
     const float b = volumeSlice.rescale[1];
+    //picked before any branching since the derivatives need every fragment of the quad
+    const float level = clamp(textureQueryLod(texSampler, fragTexCoord).y + volumeSlice.lod.x, 0.0f, volumeSlice.lod.y);
     
     if(fragTexCoord.x < 0.0f || fragTexCoord.x > 1.0f || fragTexCoord.y < 0.0f || fragTexCoord.y > 1.0f || fragTexCoord.z < 0.0f || fragTexCoord.z > 1.0f)
     {
@@ -31,7 +89,13 @@ void main()
     }
     else
     {
-        uint smple = texture(texSampler, fragTexCoord).r;
+        uint smple;
+        if(!fetchVoxel(fragTexCoord, level, smple))
+        {
+            //placeholder until the brick under the fragment is uploaded
+            outColor = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            return;
+        }
         
         const float halfWidth = 0.5f * windowWidth;
         float gray = 0.0f;
@@ -0,0 +1,248 @@
+#include "VkRSbrickCache.h"
+#include <iostream>
+#include <vector>
+
+//checks keep running after a failure so that one run reports every broken case, release builds included
+static uint32_t numChecks = 0;
+static uint32_t numFailures = 0;
+
+#define CHECK(cond)                                                                      \
+    do                                                                                   \
+    {                                                                                    \
+        numChecks++;                                                                     \
+        if (!(cond))                                                                     \
+        {                                                                                \
+            numFailures++;                                                               \
+            std::cout << __FILE__ << "(" << __LINE__ << "): check failed: " #cond << std::endl; \
+        }                                                                                \
+    } while (0)
+
+static const uint32_t NO_LIMIT = ~0u;
+
+static bool isLoad(const VkRSbrickCache::Load& load, uint32_t brick, uint32_t slot, uint32_t evicted)
+{
+    return load.brick == brick && load.slot == slot && load.evicted == evicted;
+}
+
+static uint64_t getDistance(const VkRSbrickCache& cache, uint32_t brick, const glm::uvec3& planes)
+{
+    const RSvolumeChunk region = cache.getBrickRegion(brick);
+    const int64_t dx = static_cast<int64_t>(region.xoffset + region.xcount / 2) - planes.x;
+    const int64_t dy = static_cast<int64_t>(region.yoffset + region.ycount / 2) - planes.y;
+    const int64_t dz = static_cast<int64_t>(region.zoffset + region.zcount / 2) - planes.z;
+    return static_cast<uint64_t>(dx * dx + dy * dy + dz * dz);
+}
+
+static bool contains(const std::vector<uint32_t>& bricks, uint32_t brick)
+{
+    for (uint32_t b : bricks)
+    {
+        if (b == brick)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void testInitPartialBricks()
+{
+    VkRSbrickCache cache;
+    cache.init(glm::uvec3(100, 64, 130), 64, glm::uvec3(2, 2, 1));
+
+    CHECK(cache.getGridSize() == glm::uvec3(2, 1, 3));
+    CHECK(cache.getSlotGrid() == glm::uvec3(2, 2, 1));
+    CHECK(cache.getBrickSize() == 64);
+    CHECK(cache.getNumBricks() == 6);
+    CHECK(cache.getNumSlots() == 4);
+    CHECK(cache.getPageTable().size() == 6);
+    for (uint32_t brick = 0; brick < cache.getNumBricks(); brick++)
+    {
+        CHECK(!cache.isResident(brick));
+        CHECK(cache.getPageTable()[brick] == VkRSbrickCache::NOT_RESIDENT);
+    }
+
+    //the last brick is clipped by the upper borders along x and z
+    const RSvolumeChunk last = cache.getBrickRegion(5);
+    CHECK(last.xoffset == 64 && last.yoffset == 0 && last.zoffset == 128);
+    CHECK(last.xcount == 36 && last.ycount == 64 && last.zcount == 2);
+    const RSvolumeChunk first = cache.getBrickRegion(0);
+    CHECK(first.xoffset == 0 && first.yoffset == 0 && first.zoffset == 0);
+    CHECK(first.xcount == 64 && first.ycount == 64 && first.zcount == 64);
+
+    CHECK(cache.getSlotOffset(0) == glm::uvec3(0, 0, 0));
+    CHECK(cache.getSlotOffset(1) == glm::uvec3(64, 0, 0));
+    CHECK(cache.getSlotOffset(3) == glm::uvec3(64, 64, 0));
+}
+
+static void testRequestOrderAndLimit()
+{
+    VkRSbrickCache cache;
+    cache.init(glm::uvec3(256, 64, 64), 64, glm::uvec3(4, 1, 1));
+
+    std::vector<VkRSbrickCache::Load> loads;
+    cache.request({ 3, 1, 2 }, 1, 0, 2, loads);
+    CHECK(loads.size() == 2);
+    CHECK(loads.size() == 2 && isLoad(loads[0], 3, 0, VkRSbrickCache::INVALID_BRICK));
+    CHECK(loads.size() == 2 && isLoad(loads[1], 1, 1, VkRSbrickCache::INVALID_BRICK));
+    CHECK(cache.getPageTable()[3] == 1);
+    CHECK(cache.getPageTable()[1] == 2);
+    CHECK(!cache.isResident(2));
+
+    //resident bricks need no load, the remaining one gets the next free slot
+    cache.request({ 3, 1, 2 }, 2, 0, NO_LIMIT, loads);
+    CHECK(loads.size() == 1);
+    CHECK(loads.size() == 1 && isLoad(loads[0], 2, 2, VkRSbrickCache::INVALID_BRICK));
+
+    cache.request({ 0 }, 3, 0, 0, loads);
+    CHECK(loads.empty());
+    CHECK(!cache.isResident(0));
+}
+
+static void testEvictionLeastRecentlyUsed()
+{
+    VkRSbrickCache cache;
+    cache.init(glm::uvec3(256, 64, 64), 64, glm::uvec3(2, 1, 1));
+
+    std::vector<VkRSbrickCache::Load> loads;
+    cache.request({ 0, 1 }, 1, 0, NO_LIMIT, loads);
+    CHECK(loads.size() == 2);
+    cache.request({ 1 }, 2, 1, NO_LIMIT, loads);
+    CHECK(loads.empty());
+
+    //brick 0 was sampled longest ago, so its slot is recycled
+    cache.request({ 2 }, 3, 2, NO_LIMIT, loads);
+    CHECK(loads.size() == 1);
+    CHECK(loads.size() == 1 && isLoad(loads[0], 2, 0, 0));
+    CHECK(!cache.isResident(0));
+    CHECK(cache.getPageTable()[0] == VkRSbrickCache::NOT_RESIDENT);
+    CHECK(cache.getPageTable()[2] == 1);
+    CHECK(cache.getPageTable()[1] == 2);
+
+    //bricks resident in the request are never evicted for another brick of the same request
+    cache.request({ 3, 2 }, 4, 3, NO_LIMIT, loads);
+    CHECK(loads.size() == 1);
+    CHECK(loads.size() == 1 && isLoad(loads[0], 3, 1, 1));
+    CHECK(cache.isResident(2));
+}
+
+static void testNoRecycleWhileInFlight()
+{
+    VkRSbrickCache cache;
+    cache.init(glm::uvec3(128, 64, 64), 64, glm::uvec3(1, 1, 1));
+
+    std::vector<VkRSbrickCache::Load> loads;
+    cache.request({ 0 }, 1, 0, NO_LIMIT, loads);
+    CHECK(loads.size() == 1);
+
+    //frame 1 may still sample the only slot
+    cache.request({ 1 }, 2, 0, NO_LIMIT, loads);
+    CHECK(loads.empty());
+    CHECK(cache.isResident(0));
+    CHECK(!cache.isResident(1));
+
+    cache.request({ 1 }, 3, 1, NO_LIMIT, loads);
+    CHECK(loads.size() == 1);
+    CHECK(loads.size() == 1 && isLoad(loads[0], 1, 0, 0));
+    CHECK(!cache.isResident(0));
+    CHECK(cache.isResident(1));
+}
+
+static void testTouchAtHeadAndTail()
+{
+    VkRSbrickCache cache;
+    cache.init(glm::uvec3(384, 64, 64), 64, glm::uvec3(3, 1, 1));
+
+    //least recently used first: slots 0, 1, 2
+    std::vector<VkRSbrickCache::Load> loads;
+    cache.request({ 0, 1, 2 }, 1, 0, NO_LIMIT, loads);
+    CHECK(loads.size() == 3);
+    cache.request({ 0 }, 2, 0, NO_LIMIT, loads); //head: 1, 2, 0
+    cache.request({ 2 }, 3, 0, NO_LIMIT, loads); //middle: 1, 0, 2
+    cache.request({ 2 }, 4, 0, NO_LIMIT, loads); //tail: unchanged
+    CHECK(loads.empty());
+
+    //each load moves its slot to the tail, so the slots are recycled in the order above
+    cache.request({ 3, 4, 5 }, 5, 4, NO_LIMIT, loads);
+    CHECK(loads.size() == 3);
+    CHECK(loads.size() == 3 && isLoad(loads[0], 3, 1, 1));
+    CHECK(loads.size() == 3 && isLoad(loads[1], 4, 0, 0));
+    CHECK(loads.size() == 3 && isLoad(loads[2], 5, 2, 2));
+
+    //a single slot is head and tail at once
+    VkRSbrickCache single;
+    single.init(glm::uvec3(128, 64, 64), 64, glm::uvec3(1, 1, 1));
+    single.request({ 0 }, 1, 0, NO_LIMIT, loads);
+    single.request({ 0 }, 2, 0, NO_LIMIT, loads);
+    CHECK(loads.empty());
+    single.request({ 1 }, 3, 2, NO_LIMIT, loads);
+    CHECK(loads.size() == 1 && isLoad(loads[0], 1, 0, 0));
+    single.request({ 1 }, 4, 2, NO_LIMIT, loads);
+    single.request({ 0 }, 5, 4, NO_LIMIT, loads);
+    CHECK(loads.size() == 1 && isLoad(loads[0], 0, 0, 1));
+}
+
+static void testDirtyBricksSortedAndUnique()
+{
+    VkRSbrickCache cache;
+    cache.init(glm::uvec3(256, 64, 64), 64, glm::uvec3(2, 1, 1));
+
+    std::vector<VkRSbrickCache::Load> loads;
+    cache.request({ 2, 0 }, 1, 0, NO_LIMIT, loads);
+    //evicts brick 2, so it changes twice
+    cache.request({ 1 }, 2, 1, NO_LIMIT, loads);
+    CHECK(loads.size() == 1 && isLoad(loads[0], 1, 0, 2));
+
+    std::vector<uint32_t> dirty;
+    cache.takeDirtyBricks(dirty);
+    CHECK(dirty == std::vector<uint32_t>({ 0, 1, 2 }));
+
+    cache.takeDirtyBricks(dirty);
+    CHECK(dirty.empty());
+}
+
+static void testSliceBricks()
+{
+    VkRSbrickCache cache;
+    cache.init(glm::uvec3(256, 128, 128), 64, glm::uvec3(4, 4, 1));
+    CHECK(cache.getGridSize() == glm::uvec3(4, 2, 2));
+
+    //the sagittal plane lies on the border between brick layers 0 and 1, sampling may round into either
+    const glm::uvec3 onBorder(64, 10, 10);
+    std::vector<uint32_t> bricks;
+    cache.getSliceBricks(onBorder, bricks);
+    CHECK(bricks.size() == 14);
+    CHECK(contains(bricks, 12)); //x layer 0, away from the coronal and axial planes
+    CHECK(contains(bricks, 13)); //x layer 1
+    CHECK(!contains(bricks, 14));
+    CHECK(!contains(bricks, 15));
+
+    const glm::uvec3 inside(100, 10, 10);
+    cache.getSliceBricks(inside, bricks);
+    CHECK(bricks.size() == 13);
+    CHECK(!contains(bricks, 12));
+    CHECK(contains(bricks, 13));
+
+    //nearest first
+    const glm::uvec3 planes(70, 10, 10);
+    cache.getSliceBricks(planes, bricks);
+    CHECK(!bricks.empty() && bricks[0] == 1);
+    for (size_t i = 1; i < bricks.size(); i++)
+    {
+        CHECK(getDistance(cache, bricks[i - 1], planes) <= getDistance(cache, bricks[i], planes));
+    }
+}
+
+int main()
+{
+    testInitPartialBricks();
+    testRequestOrderAndLimit();
+    testEvictionLeastRecentlyUsed();
+    testNoRecycleWhileInFlight();
+    testTouchAtHeadAndTail();
+    testDirtyBricksSortedAndUnique();
+    testSliceBricks();
+
+    std::cout << numChecks - numFailures << " of " << numChecks << " checks passed" << std::endl;
+    return numFailures == 0 ? 0 : 1;
+}
@@ -26,7 +26,7 @@ struct ModelCapabilities
 };
 
 /**
- * @brief Describes the storage type and size of indices for vertex indices stored in model files. NB: Currently rendersystem only supports 32 bit integers for indices. This enum is only depicting what is stored in  a model file that is read and loaded but is then converted to 32 bit indices for rendersystem.
+ * @brief Describes the storage type and size of indices for vertex indices stored in model files. NB: rendersystem keeps 16 and 32 bit indices as they are (see RSindexType), 8 bit indices have to be widened before they are handed to it.
  */
 enum IndicesIntType 
 {
@@ -48,7 +48,7 @@ namespace ss {
             uint32_t numVertices = static_cast<uint32_t>(qdatalist[i].positions.size());
             uint32_t numIndices = static_cast<uint32_t>(qdatalist[i].indices.size());
 
-            vkrs.geometryDataCreate(geomInfo.geomDataID, numVertices, numIndices, attribInfo);
+            vkrs.geometryDataCreate(geomInfo.geomDataID, numVertices, numIndices, attribInfo, QuadricDataFactory::getIndexType(qdatalist[i]));
             uint32_t posSizeInBytes = numVertices * sizeof(qdatalist[i].positions[0]);
             vkrs.geometryDataUpdateVertices(geomInfo.geomDataID, 0, posSizeInBytes, RSvertexAttribute::vaPosition, (void*)qdatalist[i].positions.data());
 
@@ -61,8 +61,7 @@ namespace ss {
             uint32_t texcoordSizeInBytes = numVertices * sizeof(qdatalist[i].texcoords[0]);
             vkrs.geometryDataUpdateVertices(geomInfo.geomDataID, 0, texcoordSizeInBytes, RSvertexAttribute::vaTexCoord, (void*)qdatalist[i].texcoords.data());
 
-            uint32_t indicesSizeInBytes = numIndices * sizeof(uint32_t);
-            vkrs.geometryDataUpdateIndices(geomInfo.geomDataID, 0, indicesSizeInBytes, (void*)qdatalist[i].indices.data());
+            QuadricDataFactory::updateIndices(geomInfo.geomDataID, qdatalist[i]);
             vkrs.geometryDataFinalize(geomInfo.geomDataID);
             
             RSgeometryInfo geometry;
@@ -1,6 +1,7 @@
 
 #include "QuadricDataFactory.h"
 #include "MathUtils.h"
+#include "VkRenderSystem.h"
 #include <math.h>
 
 const float QuadricDataFactory::RS_PI = 3.14159265358979323846f;
@@ -254,3 +255,25 @@ QuadricData QuadricDataFactory::createCone(float radius, uint32_t numslices, uin
 
     return qd;
 }
+
+RSindexType QuadricDataFactory::getIndexType(const QuadricData& qdata)
+{
+    return qdata.positions.size() <= 65536 ? RSindexType::itUint16 : RSindexType::itUint32;
+}
+
+void QuadricDataFactory::updateIndices(const RSgeometryDataID& gdataID, const QuadricData& qdata)
+{
+    auto& vkrs = VkRenderSystem::getInstance();
+    uint32_t numIndices = static_cast<uint32_t>(qdata.indices.size());
+    if (getIndexType(qdata) == RSindexType::itUint16)
+    {
+        std::vector<uint16_t> indices(qdata.indices.begin(), qdata.indices.end());
+        uint32_t indicesSizeInBytes = numIndices * sizeof(uint16_t);
+        vkrs.geometryDataUpdateIndices(gdataID, 0, indicesSizeInBytes, (void*)indices.data());
+    }
+    else
+    {
+        uint32_t indicesSizeInBytes = numIndices * sizeof(uint32_t);
+        vkrs.geometryDataUpdateIndices(gdataID, 0, indicesSizeInBytes, (void*)qdata.indices.data());
+    }
+}
@@ -5,6 +5,8 @@
 #include <array>
 #include <glm/glm.hpp>
 #include "BoundingBox.h"
+#include "rsenums.h"
+#include "rsids.h"
 
 struct QuadricData 
 {
@@ -79,4 +81,18 @@ public:
      * @param phimax the specified maximum phi angle
      */
     static QuadricData createDisk(float innerRadius = DEFAULT_HALF_RADIUS, float outerRadius = DEFAULT_RADIUS, uint32_t numslices = DEFAULT_NUM_SLICES, uint32_t numstacks = DEFAULT_NUM_STACKS, float z = 0, float phimax = DEFAULT_PHI_MAX);
+    
+    /**
+     * @brief Gets the index type the quadric's geometry data is created with.
+     * @param qdata the specified quadric data
+     * @return 16 bit indices when every vertex fits, 32 bit otherwise.
+     */
+    static RSindexType getIndexType(const QuadricData& qdata);
+    
+    /**
+     * @brief Uploads the indices of the quadric, converted to the index type returned by getIndexType.
+     * @param gdataID the specified geometry data created with that index type
+     * @param qdata the specified quadric data
+     */
+    static void updateIndices(const RSgeometryDataID& gdataID, const QuadricData& qdata);
 };
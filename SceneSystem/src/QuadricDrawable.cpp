@@ -20,7 +20,7 @@ namespace ss
         uint32_t numVertices = static_cast<uint32_t>(qdata.positions.size());
         uint32_t numIndices = static_cast<uint32_t>(qdata.indices.size());
         
-        vkrs.geometryDataCreate(_geomInfo.geomDataID, numVertices, numIndices, attribInfo);
+        vkrs.geometryDataCreate(_geomInfo.geomDataID, numVertices, numIndices, attribInfo, QuadricDataFactory::getIndexType(qdata));
         uint32_t posSizeInBytes = numVertices * sizeof(qdata.positions[0]);
         vkrs.geometryDataUpdateVertices(_geomInfo.geomDataID, 0, posSizeInBytes, RSvertexAttribute::vaPosition, (void*)qdata.positions.data());
 
@@ -33,8 +33,7 @@ namespace ss
         uint32_t texcoordSizeInBytes = numVertices * sizeof(qdata.texcoords[0]);
         vkrs.geometryDataUpdateVertices(_geomInfo.geomDataID, 0, texcoordSizeInBytes, RSvertexAttribute::vaTexCoord, (void*)qdata.texcoords.data());
 
-        uint32_t indicesSizeInBytes = numIndices * sizeof(uint32_t);
-        vkrs.geometryDataUpdateIndices(_geomInfo.geomDataID, 0, indicesSizeInBytes, (void*)qdata.indices.data());
+        QuadricDataFactory::updateIndices(_geomInfo.geomDataID, qdata);
         vkrs.geometryDataFinalize(_geomInfo.geomDataID);
 
         RSgeometryInfo geomInfo;